@@ -0,0 +1,98 @@
+#include "AllocationStats.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if defined (_WIN32)
+    #define NOMINMAX
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+    #include <psapi.h>
+    #pragma comment(lib, "psapi.lib")
+#else
+    #include <sys/resource.h>
+#endif
+
+#if defined (GPS_ALLOCATION_STATS)
+
+namespace {
+
+    std::atomic<size_t> allocationCount(0);
+    std::atomic<size_t> allocatedBytes(0);
+
+    void* countedAllocate(size_t size) {
+
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
+        //malloc(0) may return NULL, operator new must not
+        void* pointer = std::malloc(size > 0 ? size : 1);
+        if (pointer == NULL) {
+            throw std::bad_alloc();
+        }
+        return pointer;
+    }
+}
+
+void* operator new(size_t size) {
+    return countedAllocate(size);
+}
+
+void* operator new[](size_t size) {
+    return countedAllocate(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+#endif
+
+namespace gps {
+
+    AllocationStats AllocationStats::current() {
+
+        AllocationStats stats;
+#if defined (GPS_ALLOCATION_STATS)
+        stats.allocations = allocationCount.load(std::memory_order_relaxed);
+        stats.bytes = allocatedBytes.load(std::memory_order_relaxed);
+#endif
+        return stats;
+    }
+
+    size_t AllocationStats::peakResidentBytes() {
+
+#if defined (_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            return counters.PeakWorkingSetSize;
+        }
+        return 0;
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) != 0) {
+            return 0;
+        }
+#if defined (__APPLE__)
+        //bytes on macOS
+        return (size_t)usage.ru_maxrss;
+#else
+        //kilobytes on Linux
+        return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+    }
+}
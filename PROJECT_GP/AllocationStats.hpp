@@ -0,0 +1,28 @@
+#ifndef AllocationStats_hpp
+#define AllocationStats_hpp
+
+#include <cstddef>
+
+namespace gps {
+
+    // Process-wide heap counters, fed by the global operator new/delete replaced in AllocationStats.cpp.
+    // The replacement is only compiled into builds that define GPS_ALLOCATION_STATS, elsewhere the counters stay 0
+    struct AllocationStats {
+
+#if defined (GPS_ALLOCATION_STATS)
+        static constexpr bool COUNTING = true;
+#else
+        static constexpr bool COUNTING = false;
+#endif
+
+        size_t allocations = 0;
+        size_t bytes = 0;
+
+        static AllocationStats current();
+
+        //largest resident set of the process so far, 0 when the platform does not report it
+        static size_t peakResidentBytes();
+    };
+}
+
+#endif /* AllocationStats_hpp */
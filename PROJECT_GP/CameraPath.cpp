@@ -0,0 +1,126 @@
+#include "CameraPath.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace gps {
+
+    bool CameraPath::load(const std::string& fileName) {
+
+        poses.clear();
+
+        std::ifstream file(fileName);
+        if (!file.is_open()) {
+            std::cout << "Failed to open camera path: " << fileName << std::endl;
+            return false;
+        }
+
+        std::string line;
+        int lineNumber = 0;
+
+        while (std::getline(file, line)) {
+
+            lineNumber++;
+            line = line.substr(0, line.find('#'));
+
+            std::istringstream tokens(line);
+            CameraPose pose;
+            if (!(tokens >> pose.time)) {
+                continue;
+            }
+
+            tokens >> pose.position.x >> pose.position.y >> pose.position.z >> pose.yaw >> pose.pitch;
+            if (tokens.fail() || (!poses.empty() && pose.time < poses.back().time)) {
+                std::cout << fileName << ":" << lineNumber << ": malformed camera pose" << std::endl;
+                continue;
+            }
+            poses.push_back(pose);
+        }
+
+        return !poses.empty();
+    }
+
+    void CameraPath::clear() {
+
+        poses.clear();
+    }
+
+    void CameraPath::add(const CameraPose& pose) {
+
+        poses.push_back(pose);
+    }
+
+    bool CameraPath::empty() const {
+
+        return poses.empty();
+    }
+
+    float CameraPath::getDuration() const {
+
+        return poses.empty() ? 0.0f : poses.back().time - poses.front().time;
+    }
+
+    CameraPose CameraPath::sample(float time) const {
+
+        if (poses.size() == 1) {
+            return poses[0];
+        }
+
+        float duration = getDuration();
+        float t = poses.front().time + (duration > 0.0f ? std::fmod(time, duration) : 0.0f);
+
+        //first pose later than t, the one before it starts the segment
+        std::vector<CameraPose>::const_iterator next = std::upper_bound(poses.begin(), poses.end(), t,
+            [](float value, const CameraPose& pose) { return value < pose.time; });
+        if (next == poses.begin()) {
+            return poses.front();
+        }
+        if (next == poses.end()) {
+            return poses.back();
+        }
+
+        const CameraPose& a = *(next - 1);
+        const CameraPose& b = *next;
+        float span = b.time - a.time;
+        float f = span > 0.0f ? (t - a.time) / span : 0.0f;
+
+        float yawDelta = std::fmod(b.yaw - a.yaw + 540.0f, 360.0f) - 180.0f;
+
+        CameraPose pose;
+        pose.time = t;
+        pose.position = glm::mix(a.position, b.position, f);
+        pose.yaw = a.yaw + yawDelta * f;
+        pose.pitch = a.pitch + (b.pitch - a.pitch) * f;
+        return pose;
+    }
+
+    bool CameraPath::beginRecording(const std::string& fileName) {
+
+        recording = fopen(fileName.c_str(), "w");
+        if (!recording) {
+            std::cout << "Can't record the camera path to " << fileName << std::endl;
+            return false;
+        }
+        fprintf(recording, "# time px py pz yaw pitch\n");
+        return true;
+    }
+
+    void CameraPath::record(const CameraPose& pose) {
+
+        if (!recording) {
+            return;
+        }
+        fprintf(recording, "%.4f %.5f %.5f %.5f %.3f %.3f\n", pose.time, pose.position.x, pose.position.y, pose.position.z, pose.yaw, pose.pitch);
+    }
+
+    void CameraPath::endRecording() {
+
+        if (recording) {
+            fclose(recording);
+            recording = NULL;
+        }
+    }
+}
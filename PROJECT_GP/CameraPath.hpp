@@ -0,0 +1,48 @@
+#ifndef CameraPath_hpp
+#define CameraPath_hpp
+
+#include <glm/glm.hpp>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // camera pose at a point in time; angles in degrees, as the mouse look uses them
+    struct CameraPose {
+
+        float time;
+        glm::vec3 position;
+        float yaw;
+        float pitch;
+    };
+
+    // Recorded camera motion for repeatable runs. The text format holds one pose per line,
+    // "time px py pz yaw pitch", with times in seconds and increasing; '#' starts a comment
+    class CameraPath {
+
+    public:
+        bool load(const std::string& fileName);
+
+        void clear();
+        void add(const CameraPose& pose);
+        bool empty() const;
+        float getDuration() const;
+
+        //pose at time, interpolated between the neighbouring samples (yaw the short way round);
+        //past the end the path starts over
+        CameraPose sample(float time) const;
+
+        //appending to a file while the app runs, one line per call
+        bool beginRecording(const std::string& fileName);
+        void record(const CameraPose& pose);
+        void endRecording();
+
+    private:
+        std::vector<CameraPose> poses;
+        FILE* recording = NULL;
+    };
+}
+
+#endif /* CameraPath_hpp */
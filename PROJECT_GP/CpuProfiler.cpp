@@ -0,0 +1,115 @@
+#include "CpuProfiler.hpp"
+
+#if defined (GPS_CPU_PROFILER)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+namespace gps {
+
+    namespace {
+
+        //one per thread; only its own thread writes it
+        struct ThreadRing {
+            CpuProfiler::Event events[CpuProfiler::RING_EVENTS];
+            std::atomic<uint64_t> written;
+            int threadIndex;
+        };
+
+        std::mutex ringsMutex;
+        std::vector<ThreadRing*> rings;
+        thread_local ThreadRing* threadRing = NULL;
+
+        ThreadRing* createThreadRing() {
+
+            ThreadRing* ring = new ThreadRing();
+            ring->written.store(0, std::memory_order_relaxed);
+
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            ring->threadIndex = (int)rings.size();
+            rings.push_back(ring);
+            return ring;
+        }
+
+        void writeEscaped(FILE* file, const char* text) {
+
+            for (; *text; text++) {
+                if (*text == '"' || *text == '\\') {
+                    fputc('\\', file);
+                }
+                fputc(*text, file);
+            }
+        }
+    }
+
+    int64_t CpuProfiler::nowNs() {
+
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void CpuProfiler::record(const char* name, int64_t beginNs, int64_t endNs) {
+
+        ThreadRing* ring = threadRing;
+        if (!ring) {
+            ring = threadRing = createThreadRing();
+        }
+
+        uint64_t index = ring->written.load(std::memory_order_relaxed);
+        Event& event = ring->events[index % RING_EVENTS];
+        event.name = name;
+        event.beginNs = beginNs;
+        event.endNs = endNs;
+        ring->written.store(index + 1, std::memory_order_release);
+    }
+
+    bool CpuProfiler::writeChromeTrace(const std::string& fileName) {
+
+        FILE* file = fopen(fileName.c_str(), "w");
+        if (!file) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(ringsMutex);
+
+        //timestamps relative to the oldest event kept, in microseconds as the format wants
+        int64_t originNs = INT64_MAX;
+        for (ThreadRing* ring : rings) {
+            uint64_t written = ring->written.load(std::memory_order_acquire);
+            uint64_t first = written > RING_EVENTS ? written - RING_EVENTS : 0;
+            for (uint64_t i = first; i < written; i++) {
+                originNs = std::min(originNs, ring->events[i % RING_EVENTS].beginNs);
+            }
+        }
+
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        bool firstEvent = true;
+
+        for (ThreadRing* ring : rings) {
+
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                firstEvent ? "" : ",\n", ring->threadIndex, ring->threadIndex == 0 ? "main" : "worker");
+            firstEvent = false;
+
+            uint64_t written = ring->written.load(std::memory_order_acquire);
+            uint64_t first = written > RING_EVENTS ? written - RING_EVENTS : 0;
+
+            for (uint64_t i = first; i < written; i++) {
+                const Event& event = ring->events[i % RING_EVENTS];
+                fprintf(file, ",\n{\"name\":\"");
+                writeEscaped(file, event.name);
+                fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    ring->threadIndex, (event.beginNs - originNs) / 1000.0, (event.endNs - event.beginNs) / 1000.0);
+            }
+        }
+
+        fprintf(file, "\n]}\n");
+        fclose(file);
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef CpuProfiler_hpp
+#define CpuProfiler_hpp
+
+// Scoped CPU zones exported as Chrome trace_event JSON (open in Perfetto or chrome://tracing).
+// Everything here compiles to nothing unless GPS_CPU_PROFILER is defined, add it to the preprocessor
+// definitions of the build to profile:
+//
+//     void loadLevel() {
+//         PROFILE_ZONE("loadLevel");
+//         ...
+//     }
+
+#if defined (GPS_CPU_PROFILER)
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace gps {
+
+    class CpuProfiler {
+
+    public:
+        //zone names are kept as pointers, so they must be string literals or live as long
+        struct Event {
+            const char* name;
+            int64_t beginNs;
+            int64_t endNs;
+        };
+
+        //latest events kept per thread, older ones are overwritten
+        static constexpr uint32_t RING_EVENTS = 1u << 18;
+
+        static int64_t nowNs();
+        //the calling thread's ring is allocated on its first event, afterwards recording never allocates
+        static void record(const char* name, int64_t beginNs, int64_t endNs);
+        //call with the other threads idle; false if the file can't be written
+        static bool writeChromeTrace(const std::string& fileName);
+    };
+
+    class CpuZone {
+
+    public:
+        explicit CpuZone(const char* name) : name(name), beginNs(CpuProfiler::nowNs()) {}
+        ~CpuZone() { CpuProfiler::record(name, beginNs, CpuProfiler::nowNs()); }
+
+        CpuZone(const CpuZone&) = delete;
+        CpuZone& operator=(const CpuZone&) = delete;
+
+    private:
+        const char* name;
+        int64_t beginNs;
+    };
+}
+
+#define GPS_PROFILE_CONCAT_INNER(a, b) a##b
+#define GPS_PROFILE_CONCAT(a, b) GPS_PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) gps::CpuZone GPS_PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define PROFILE_WRITE_TRACE(fileName) gps::CpuProfiler::writeChromeTrace(fileName)
+
+#else
+
+#define PROFILE_ZONE(name) ((void)0)
+#define PROFILE_WRITE_TRACE(fileName) false
+
+#endif
+
+#endif /* CpuProfiler_hpp */
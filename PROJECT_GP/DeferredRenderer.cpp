@@ -0,0 +1,178 @@
+#include "DeferredRenderer.hpp"
+#include "Shader.hpp"
+
+#include <glm/gtc/constants.hpp>
+
+#include <iostream>
+#include <vector>
+
+namespace gps {
+
+    void DeferredRenderer::init(int width, int height) {
+
+        this->width = width;
+        this->height = height;
+
+        glGenFramebuffers(1, &gBufferFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, gBufferFBO);
+
+        albedoTexture = createTarget(GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_COLOR_ATTACHMENT0);
+        normalTexture = createTarget(GL_RGBA16F, GL_RGBA, GL_FLOAT, GL_COLOR_ATTACHMENT1);
+        specularTexture = createTarget(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, GL_COLOR_ATTACHMENT2);
+        depthTexture = createTarget(GL_R32F, GL_RED, GL_FLOAT, GL_COLOR_ATTACHMENT3);
+
+        glGenRenderbuffers(1, &depthRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+        //same format as the default framebuffer so the Hi-Z capture can blit from either
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        GLenum drawBuffers[4] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3 };
+        glDrawBuffers(4, drawBuffers);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "G-buffer framebuffer is incomplete" << std::endl;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        //core profile needs a VAO bound even when the vertices come from gl_VertexID
+        glGenVertexArrays(1, &fullScreenVAO);
+
+        createLightVolume();
+    }
+
+    GLuint DeferredRenderer::createTarget(GLenum internalFormat, GLenum format, GLenum type, GLenum attachment) {
+
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        return texture;
+    }
+
+    void DeferredRenderer::createLightVolume() {
+
+        const int slices = 16;
+        const int stacks = 8;
+
+        //the flat faces of the tessellated sphere sit inside the unit sphere, push them back out
+        float enlarge = 1.0f / (glm::cos(glm::pi<float>() / slices) * glm::cos(glm::pi<float>() / (2 * stacks)));
+
+        std::vector<glm::vec3> vertices;
+        std::vector<GLuint> indices;
+
+        for (int stack = 0; stack <= stacks; stack++) {
+
+            float phi = glm::pi<float>() * stack / stacks;
+
+            for (int slice = 0; slice <= slices; slice++) {
+
+                float theta = 2.0f * glm::pi<float>() * slice / slices;
+                vertices.push_back(enlarge * glm::vec3(
+                    glm::sin(phi) * glm::cos(theta),
+                    glm::cos(phi),
+                    glm::sin(phi) * glm::sin(theta)));
+            }
+        }
+
+        for (int stack = 0; stack < stacks; stack++) {
+            for (int slice = 0; slice < slices; slice++) {
+
+                GLuint first = stack * (slices + 1) + slice;
+                GLuint second = first + slices + 1;
+
+                //counter-clockwise seen from outside
+                indices.push_back(first);
+                indices.push_back(first + 1);
+                indices.push_back(second);
+
+                indices.push_back(second);
+                indices.push_back(first + 1);
+                indices.push_back(second + 1);
+            }
+        }
+
+        sphereIndexCount = (GLsizei)indices.size();
+
+        glGenVertexArrays(1, &sphereVAO);
+        glGenBuffers(1, &sphereVBO);
+        glGenBuffers(1, &sphereEBO);
+
+        glBindVertexArray(sphereVAO);
+
+        glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+
+        glBindVertexArray(0);
+    }
+
+    void DeferredRenderer::destroy() {
+
+        GLuint textures[4] = { albedoTexture, normalTexture, specularTexture, depthTexture };
+        glDeleteTextures(4, textures);
+        glDeleteRenderbuffers(1, &depthRenderbuffer);
+        glDeleteFramebuffers(1, &gBufferFBO);
+
+        glDeleteVertexArrays(1, &fullScreenVAO);
+
+        glDeleteBuffers(1, &sphereVBO);
+        glDeleteBuffers(1, &sphereEBO);
+        glDeleteVertexArrays(1, &sphereVAO);
+    }
+
+    void DeferredRenderer::beginGeometryPass() {
+
+        glBindFramebuffer(GL_FRAMEBUFFER, gBufferFBO);
+        glViewport(0, 0, width, height);
+        //the clear color is black, so gDepth starts at 0 = empty
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    void DeferredRenderer::bindGBufferTextures(GLuint shaderProgram) {
+
+        const char* names[4] = { "gAlbedo", "gNormal", "gSpecular", "gDepth" };
+        GLuint textures[4] = { albedoTexture, normalTexture, specularTexture, depthTexture };
+
+        for (GLuint i = 0; i < 4; i++) {
+
+            glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glUniform1i(Shader::getUniformLocation(shaderProgram, names[i]), FIRST_TEXTURE_UNIT + i);
+        }
+
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    GLuint DeferredRenderer::getFramebuffer() const {
+        return gBufferFBO;
+    }
+
+    void DeferredRenderer::drawFullScreen() {
+
+        glBindVertexArray(fullScreenVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+    }
+
+    void DeferredRenderer::drawLightVolume() {
+
+        glBindVertexArray(sphereVAO);
+        glDrawElements(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef DeferredRenderer_hpp
+#define DeferredRenderer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+namespace gps {
+
+    // G-buffer and helper geometry for the deferred shading path:
+    // attachment 0 - albedo (sRGB), 1 - eye space normal, 2 - specular map, 3 - linear eye depth
+    class DeferredRenderer {
+
+    public:
+        //first of the four consecutive texture units the G-buffer is sampled from
+        static constexpr GLuint FIRST_TEXTURE_UNIT = 7;
+
+        void init(int width, int height);
+        void destroy();
+
+        //binds and clears the G-buffer for the geometry pass
+        void beginGeometryPass();
+
+        //binds the G-buffer textures to gAlbedo, gNormal, gSpecular and gDepth of the program (must be in use)
+        void bindGBufferTextures(GLuint shaderProgram);
+
+        GLuint getFramebuffer() const;
+
+        //full-screen triangle for the directional/spot light pass
+        void drawFullScreen();
+
+        //unit sphere for point light volumes, slightly enlarged so its faces enclose the radius
+        void drawLightVolume();
+
+    private:
+        int width;
+        int height;
+
+        GLuint gBufferFBO;
+        GLuint albedoTexture;
+        GLuint normalTexture;
+        GLuint specularTexture;
+        GLuint depthTexture;
+        GLuint depthRenderbuffer;
+
+        GLuint fullScreenVAO;
+
+        GLuint sphereVAO;
+        GLuint sphereVBO;
+        GLuint sphereEBO;
+        GLsizei sphereIndexCount;
+
+        GLuint createTarget(GLenum internalFormat, GLenum format, GLenum type, GLenum attachment);
+        void createLightVolume();
+    };
+}
+
+#endif /* DeferredRenderer_hpp */
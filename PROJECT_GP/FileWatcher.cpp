@@ -0,0 +1,151 @@
+#include "FileWatcher.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#if defined (__linux__)
+    #include <sys/inotify.h>
+    #include <unistd.h>
+    #include <cerrno>
+#endif
+
+namespace gps {
+
+#if defined (__linux__)
+
+    bool FileWatcher::init(const std::string& directory) {
+
+        this->directory = directory;
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd < 0) {
+            std::cout << "FileWatcher: inotify unavailable" << std::endl;
+            return false;
+        }
+
+        //editors either rewrite the file in place or write a temporary and rename it over the original
+        watchDescriptor = inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watchDescriptor < 0) {
+            std::cout << "FileWatcher: can't watch " << directory << std::endl;
+            destroy();
+            return false;
+        }
+        return true;
+    }
+
+    void FileWatcher::destroy() {
+
+        if (inotifyFd >= 0) {
+            close(inotifyFd);
+        }
+        inotifyFd = -1;
+        watchDescriptor = -1;
+    }
+
+    std::vector<std::string> FileWatcher::poll() {
+
+        std::vector<std::string> changed;
+        if (inotifyFd < 0) {
+            return changed;
+        }
+
+        alignas(inotify_event) char buffer[4096];
+        while (true) {
+
+            ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+            if (length <= 0) {
+                //EAGAIN: nothing more queued
+                break;
+            }
+
+            for (ssize_t offset = 0; offset < length;) {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                if (event->len > 0) {
+                    std::string path = directory + "/" + event->name;
+                    if (std::find(changed.begin(), changed.end(), path) == changed.end()) {
+                        changed.push_back(path);
+                    }
+                }
+                offset += sizeof(inotify_event) + event->len;
+            }
+        }
+
+        return changed;
+    }
+
+    const char* FileWatcher::getMethod() const {
+
+        return "inotify";
+    }
+
+#else
+
+    bool FileWatcher::init(const std::string& directory) {
+
+        this->directory = directory;
+        std::error_code error;
+        if (!std::filesystem::is_directory(directory, error)) {
+            std::cout << "FileWatcher: can't watch " << directory << std::endl;
+            return false;
+        }
+
+        //the first scan only records the current state
+        scan(false);
+        lastScan = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    void FileWatcher::destroy() {
+
+        writeTimes.clear();
+        directory.clear();
+    }
+
+    std::vector<std::string> FileWatcher::poll() {
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (directory.empty() || now - lastScan < std::chrono::milliseconds(SCAN_INTERVAL_MS)) {
+            return std::vector<std::string>();
+        }
+
+        lastScan = now;
+        return scan(true);
+    }
+
+    std::vector<std::string> FileWatcher::scan(bool report) {
+
+        std::vector<std::string> changed;
+        std::error_code error;
+
+        for (std::filesystem::directory_iterator entry(directory, error), end; !error && entry != end; entry.increment(error)) {
+
+            if (!entry->is_regular_file(error)) {
+                continue;
+            }
+
+            std::string path = directory + "/" + entry->path().filename().string();
+            std::filesystem::file_time_type writeTime = entry->last_write_time(error);
+            if (error) {
+                //the file can be mid-save, the next scan will see it
+                error.clear();
+                continue;
+            }
+
+            std::map<std::string, std::filesystem::file_time_type>::iterator known = writeTimes.find(path);
+            if (known == writeTimes.end() || known->second != writeTime) {
+                if (report) {
+                    changed.push_back(path);
+                }
+                writeTimes[path] = writeTime;
+            }
+        }
+
+        return changed;
+    }
+
+    const char* FileWatcher::getMethod() const {
+
+        return "polling";
+    }
+
+#endif
+}
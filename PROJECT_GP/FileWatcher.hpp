@@ -0,0 +1,44 @@
+#ifndef FileWatcher_hpp
+#define FileWatcher_hpp
+
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Reports the files of one directory (not its subdirectories) that were written since the last poll.
+    // Uses inotify on Linux; elsewhere the modification times are compared a couple of times per second
+    class FileWatcher {
+
+    public:
+        //false if the directory can't be watched
+        bool init(const std::string& directory);
+        void destroy();
+
+        //paths of the changed files, as directory + "/" + name, each at most once; never blocks
+        std::vector<std::string> poll();
+
+        //"inotify" or "polling"
+        const char* getMethod() const;
+
+    private:
+        static constexpr int SCAN_INTERVAL_MS = 500;
+
+        std::string directory;
+#if defined (__linux__)
+        int inotifyFd = -1;
+        int watchDescriptor = -1;
+#else
+        std::map<std::string, std::filesystem::file_time_type> writeTimes;
+        std::chrono::steady_clock::time_point lastScan;
+
+        //updates writeTimes; with report, returns the files that are new or were modified since the previous scan
+        std::vector<std::string> scan(bool report);
+#endif
+    };
+}
+
+#endif /* FileWatcher_hpp */
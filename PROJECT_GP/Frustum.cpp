@@ -0,0 +1,122 @@
+#include "Frustum.hpp"
+
+//x64 always has SSE2; other targets (e.g. Apple silicon) take the scalar loop
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define FRUSTUM_USE_SSE
+    #include <emmintrin.h>
+#endif
+
+namespace gps {
+
+    void BoundingSpheres::add(glm::vec3 center, float sphereRadius) {
+
+        //overwrite the padding slot if there is one, otherwise grow by a block of 4
+        if (count == centerX.size()) {
+            centerX.resize(count + 4, 0.0f);
+            centerY.resize(count + 4, 0.0f);
+            centerZ.resize(count + 4, 0.0f);
+            radius.resize(count + 4, 0.0f);
+        }
+
+        centerX[count] = center.x;
+        centerY[count] = center.y;
+        centerZ[count] = center.z;
+        radius[count] = sphereRadius;
+        count++;
+    }
+
+    void BoundingSpheres::clear() {
+
+        centerX.clear();
+        centerY.clear();
+        centerZ.clear();
+        radius.clear();
+        count = 0;
+    }
+
+    void Frustum::extract(const glm::mat4& clipMatrix) {
+
+        //glm is column major, row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+        glm::vec4 rowX(clipMatrix[0][0], clipMatrix[1][0], clipMatrix[2][0], clipMatrix[3][0]);
+        glm::vec4 rowY(clipMatrix[0][1], clipMatrix[1][1], clipMatrix[2][1], clipMatrix[3][1]);
+        glm::vec4 rowZ(clipMatrix[0][2], clipMatrix[1][2], clipMatrix[2][2], clipMatrix[3][2]);
+        glm::vec4 rowW(clipMatrix[0][3], clipMatrix[1][3], clipMatrix[2][3], clipMatrix[3][3]);
+
+        planes[0] = rowW + rowX; // left
+        planes[1] = rowW - rowX; // right
+        planes[2] = rowW + rowY; // bottom
+        planes[3] = rowW - rowY; // top
+        planes[4] = rowW + rowZ; // near
+        planes[5] = rowW - rowZ; // far
+
+        for (int i = 0; i < 6; i++) {
+            normalLengths[i] = glm::length(glm::vec3(planes[i]));
+        }
+    }
+
+    bool Frustum::intersectsSphere(glm::vec3 center, float sphereRadius) const {
+
+        for (int i = 0; i < 6; i++) {
+            if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -sphereRadius * normalLengths[i]) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    int Frustum::intersectSpheres(const BoundingSpheres& spheres, std::vector<uint8_t>& visible) const {
+
+        visible.resize(spheres.centerX.size());
+        int visibleCount = 0;
+
+#ifdef FRUSTUM_USE_SSE
+        __m128 planeX[6], planeY[6], planeZ[6], planeW[6], planeLength[6];
+        for (int p = 0; p < 6; p++) {
+            planeX[p] = _mm_set1_ps(planes[p].x);
+            planeY[p] = _mm_set1_ps(planes[p].y);
+            planeZ[p] = _mm_set1_ps(planes[p].z);
+            planeW[p] = _mm_set1_ps(planes[p].w);
+            planeLength[p] = _mm_set1_ps(-normalLengths[p]);
+        }
+
+        //4 spheres against all 6 planes per iteration, the arrays are padded to a multiple of 4
+        for (size_t i = 0; i < spheres.centerX.size(); i += 4) {
+
+            __m128 x = _mm_loadu_ps(&spheres.centerX[i]);
+            __m128 y = _mm_loadu_ps(&spheres.centerY[i]);
+            __m128 z = _mm_loadu_ps(&spheres.centerZ[i]);
+            __m128 r = _mm_loadu_ps(&spheres.radius[i]);
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+            for (int p = 0; p < 6; p++) {
+
+                __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+                    _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_mul_ps(r, planeLength[p])));
+            }
+
+            int mask = _mm_movemask_ps(inside);
+            for (int lane = 0; lane < 4; lane++) {
+                visible[i + lane] = (uint8_t)((mask >> lane) & 1);
+            }
+        }
+
+        for (size_t i = 0; i < spheres.count; i++) {
+            visibleCount += visible[i];
+        }
+#else
+        for (size_t i = 0; i < spheres.count; i++) {
+
+            glm::vec3 center(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]);
+            visible[i] = intersectsSphere(center, spheres.radius[i]) ? 1 : 0;
+            visibleCount += visible[i];
+        }
+#endif
+
+        return visibleCount;
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef Frustum_hpp
+#define Frustum_hpp
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // bounding spheres in structure-of-arrays layout, padded to a multiple of 4 for the SSE path
+    struct BoundingSpheres {
+
+        std::vector<float> centerX;
+        std::vector<float> centerY;
+        std::vector<float> centerZ;
+        std::vector<float> radius;
+        size_t count = 0;
+
+        void add(glm::vec3 center, float sphereRadius);
+        void clear();
+    };
+
+    class Frustum {
+
+    public:
+        //Gribb/Hartmann plane extraction; pass projection * view * model to get the planes in that model's object space
+        void extract(const glm::mat4& clipMatrix);
+
+        bool intersectsSphere(glm::vec3 center, float sphereRadius) const;
+
+        //visible[i] = 1 if sphere i is at least partially inside, returns the number of visible spheres
+        int intersectSpheres(const BoundingSpheres& spheres, std::vector<uint8_t>& visible) const;
+
+    private:
+        //left unnormalized so the object space test stays exact under non-uniform scale:
+        //a sphere of radius r maps to an ellipsoid whose extent along the plane is r * |normal|
+        glm::vec4 planes[6];
+        float normalLengths[6];
+    };
+}
+
+#endif /* Frustum_hpp */
@@ -0,0 +1,108 @@
+#include "GoldenImage.hpp"
+
+#include "stb_image.h"
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+namespace gps {
+
+    void GoldenImage::readFramebuffer(GLuint framebuffer, int width, int height, Image& image) {
+
+        GLint readFramebuffer;
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+        GLint packAlignment;
+        glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glReadBuffer(framebuffer ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+        image.width = width;
+        image.height = height;
+        image.pixels.resize((size_t)width * height * 3);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, image.pixels.data());
+
+        glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+    }
+
+    bool GoldenImage::loadPng(const std::string& fileName, Image& image) {
+
+        int width, height, channels;
+        stbi_set_flip_vertically_on_load(true);
+        unsigned char* data = stbi_load(fileName.c_str(), &width, &height, &channels, 3);
+        stbi_set_flip_vertically_on_load(false);
+        if (!data) {
+            return false;
+        }
+
+        image.width = width;
+        image.height = height;
+        image.pixels.assign(data, data + (size_t)width * height * 3);
+        stbi_image_free(data);
+        return true;
+    }
+
+    bool GoldenImage::savePng(const std::string& fileName, const Image& image) {
+
+        if (image.pixels.empty()) {
+            return false;
+        }
+
+        //PNG rows start at the top, so the last row is written first
+        const int stride = image.width * 3;
+        const unsigned char* topRow = image.pixels.data() + (size_t)(image.height - 1) * stride;
+        return stbi_write_png(fileName.c_str(), image.width, image.height, 3, topRow, -stride) != 0;
+    }
+
+    double GoldenImage::psnr(const Image& reference, const Image& image) {
+
+        if (reference.width != image.width || reference.height != image.height || reference.pixels.empty()) {
+            return 0.0;
+        }
+
+        double squaredError = 0.0;
+        for (size_t i = 0; i < reference.pixels.size(); i++) {
+            double difference = (double)reference.pixels[i] - image.pixels[i];
+            squaredError += difference * difference;
+        }
+        if (squaredError == 0.0) {
+            return std::numeric_limits<double>::infinity();
+        }
+
+        double meanSquaredError = squaredError / reference.pixels.size();
+        return 10.0 * log10(255.0 * 255.0 / meanSquaredError);
+    }
+
+    int GoldenImage::makeDiff(const Image& reference, const Image& image, int threshold, Image& diff) {
+
+        diff.width = reference.width;
+        diff.height = reference.height;
+        diff.pixels.assign(reference.pixels.size(), 0);
+        if (reference.width != image.width || reference.height != image.height) {
+            return reference.width * reference.height;
+        }
+
+        int marked = 0;
+        for (size_t i = 0; i < reference.pixels.size(); i += 3) {
+
+            int difference = 0;
+            for (int c = 0; c < 3; c++) {
+                difference = std::max(difference, abs((int)reference.pixels[i + c] - (int)image.pixels[i + c]));
+            }
+
+            if (difference > threshold) {
+                diff.pixels[i] = (unsigned char)std::min(255, 128 + difference);
+                marked++;
+            } else {
+                unsigned char gray = (unsigned char)((reference.pixels[i] + reference.pixels[i + 1] + reference.pixels[i + 2]) / 9);
+                diff.pixels[i] = diff.pixels[i + 1] = diff.pixels[i + 2] = gray;
+            }
+        }
+        return marked;
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef GoldenImage_hpp
+#define GoldenImage_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    //8 bit RGB, rows from the bottom as GL reads them
+    struct Image {
+        int width = 0;
+        int height = 0;
+        std::vector<unsigned char> pixels;
+    };
+
+    // Framebuffer readback and the comparisons behind --golden: renders are checked against
+    // reference PNGs by PSNR, and the pixels that changed are marked in a diff image.
+    class GoldenImage {
+
+    public:
+        //reads the color of framebuffer (0 = the back buffer) as stored, so sRGB targets stay sRGB-encoded
+        static void readFramebuffer(GLuint framebuffer, int width, int height, Image& image);
+
+        static bool loadPng(const std::string& fileName, Image& image);
+        static bool savePng(const std::string& fileName, const Image& image);
+
+        //over all channels in dB, infinite for identical images, 0 if the sizes differ
+        static double psnr(const Image& reference, const Image& image);
+
+        //pixels with a channel off by more than threshold in red, the rest as the dimmed reference;
+        //returns how many were marked
+        static int makeDiff(const Image& reference, const Image& image, int threshold, Image& diff);
+    };
+}
+
+#endif /* GoldenImage_hpp */
@@ -0,0 +1,267 @@
+#include "GpuProfiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace gps {
+
+    void GpuProfiler::init(int maxScopes) {
+
+        this->maxScopes = maxScopes;
+        for (int i = 0; i < POOL_FRAMES; i++) {
+            pool[i].queries.resize(2 * maxScopes);
+            glGenQueries(2 * maxScopes, pool[i].queries.data());
+            pool[i].scopes.reserve(maxScopes);
+        }
+        openScopes.reserve(maxScopes);
+        enabled = true;
+    }
+
+    void GpuProfiler::destroy() {
+
+        if (!enabled) {
+            return;
+        }
+
+        for (int i = 0; i < POOL_FRAMES; i++) {
+            glDeleteQueries((GLsizei)pool[i].queries.size(), pool[i].queries.data());
+            pool[i].queries.clear();
+        }
+        if (csv) {
+            fclose(csv);
+            csv = NULL;
+        }
+        enabled = false;
+    }
+
+    bool GpuProfiler::isEnabled() const {
+
+        return enabled;
+    }
+
+    bool GpuProfiler::openCsv(const std::string& fileName) {
+
+        csv = fopen(fileName.c_str(), "w");
+        if (!csv) {
+            return false;
+        }
+        fprintf(csv, "frame,scope,depth,ms\n");
+        return true;
+    }
+
+    void GpuProfiler::beginFrame() {
+
+        if (!enabled) {
+            return;
+        }
+
+        //the half about to be reused was issued POOL_FRAMES frames ago, unless collect() got to it first
+        collect();
+        FrameQueries& frame = pool[current];
+
+        frame.scopes.clear();
+        frame.used = 0;
+        frame.frame = frameNumber++;
+        openScopes.clear();
+    }
+
+    void GpuProfiler::endFrame() {
+
+        if (!enabled) {
+            return;
+        }
+
+        //scopes left open are closed here so every begin has an end
+        while (!openScopes.empty()) {
+            endScope();
+        }
+
+        pool[current].pending = !pool[current].scopes.empty();
+        current = (current + 1) % POOL_FRAMES;
+    }
+
+    void GpuProfiler::collect() {
+
+        if (!enabled) {
+            return;
+        }
+
+        FrameQueries& frame = pool[current];
+        if (frame.pending) {
+            resolve(frame, keepingFrameTimes);
+        }
+    }
+
+    void GpuProfiler::beginScope(const char* name) {
+
+        if (!enabled) {
+            return;
+        }
+
+        FrameQueries& frame = pool[current];
+        if ((int)frame.scopes.size() >= maxScopes) {
+            //still tracked so the matching endScope() pops it
+            openScopes.push_back(-1);
+            return;
+        }
+
+        Scope scope = { name, (int)openScopes.size(), frame.used++, -1 };
+        glQueryCounter(frame.queries[scope.beginQuery], GL_TIMESTAMP);
+        openScopes.push_back((int)frame.scopes.size());
+        frame.scopes.push_back(scope);
+    }
+
+    void GpuProfiler::endScope() {
+
+        if (!enabled || openScopes.empty()) {
+            return;
+        }
+
+        int index = openScopes.back();
+        openScopes.pop_back();
+        if (index < 0) {
+            return;
+        }
+
+        FrameQueries& frame = pool[current];
+        frame.scopes[index].endQuery = frame.used++;
+        glQueryCounter(frame.queries[frame.scopes[index].endQuery], GL_TIMESTAMP);
+    }
+
+    void GpuProfiler::resolve(FrameQueries& frame, bool wait) {
+
+        frame.pending = false;
+
+        //the last timestamp issued is the last to finish, if it is there all of them are
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(frame.queries[frame.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available && !wait) {
+            framesDropped++;
+            return;
+        }
+
+        GLuint64 frameBegin = ~(GLuint64)0;
+        GLuint64 frameEnd = 0;
+
+        for (const Scope& scope : frame.scopes) {
+
+            GLuint64 begin = 0;
+            GLuint64 end = 0;
+            glGetQueryObjectui64v(frame.queries[scope.beginQuery], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(frame.queries[scope.endQuery], GL_QUERY_RESULT, &end);
+            frameBegin = std::min(frameBegin, begin);
+            frameEnd = std::max(frameEnd, end);
+
+            double ms = (end - begin) / 1000000.0;
+            record(scope, ms);
+            if (csv) {
+                fprintf(csv, "%lld,%s,%d,%.4f\n", frame.frame, scope.name, scope.depth, ms);
+            }
+        }
+
+        if (keepingFrameTimes) {
+            frameTimes.push_back((frameEnd - frameBegin) / 1000000.0);
+        }
+        framesResolved++;
+    }
+
+    void GpuProfiler::flush() {
+
+        if (!enabled) {
+            return;
+        }
+
+        //oldest first, so frame times stay in order
+        for (int i = 0; i < POOL_FRAMES; i++) {
+            FrameQueries& frame = pool[(current + i) % POOL_FRAMES];
+            if (frame.pending) {
+                resolve(frame, true);
+            }
+        }
+    }
+
+    void GpuProfiler::keepFrameTimes(bool keep) {
+
+        keepingFrameTimes = keep;
+    }
+
+    const std::vector<double>& GpuProfiler::getFrameTimes() const {
+
+        return frameTimes;
+    }
+
+    void GpuProfiler::clearFrameTimes() {
+
+        frameTimes.clear();
+    }
+
+    void GpuProfiler::record(const Scope& scope, double ms) {
+
+        for (ScopeStats& entry : stats) {
+            if (entry.name == scope.name || strcmp(entry.name, scope.name) == 0) {
+                entry.totalMs += ms;
+                entry.maxMs = std::max(entry.maxMs, ms);
+                entry.count++;
+                entry.lastMs = ms;
+                return;
+            }
+        }
+
+        ScopeStats entry = { scope.name, scope.depth, ms, ms, 1, ms };
+        stats.push_back(entry);
+    }
+
+    const std::vector<GpuProfiler::ScopeStats>& GpuProfiler::getStats() const {
+
+        return stats;
+    }
+
+    double GpuProfiler::getLastMs(const char* name) const {
+
+        for (const ScopeStats& entry : stats) {
+            if (entry.name == name || strcmp(entry.name, name) == 0) {
+                return entry.lastMs;
+            }
+        }
+        return 0.0;
+    }
+
+    int GpuProfiler::getFramesResolved() const {
+
+        return framesResolved;
+    }
+
+    int GpuProfiler::getFramesDropped() const {
+
+        return framesDropped;
+    }
+
+    void GpuProfiler::printStats() const {
+
+        if (framesResolved == 0) {
+            return;
+        }
+
+        printf("GPU profile, %d frames (%d dropped while the GPU was behind)\n", framesResolved, framesDropped);
+        for (const ScopeStats& entry : stats) {
+            if (entry.count == 0) {
+                continue;
+            }
+            //averaged over the frames the scope ran in, a culled model simply has fewer samples
+            printf("  %*s%-*s %7.3f ms avg %7.3f ms max  (%d)\n", entry.depth * 2, "", 24 - entry.depth * 2, entry.name,
+                entry.totalMs / entry.count, entry.maxMs, entry.count);
+        }
+    }
+
+    void GpuProfiler::resetStats() {
+
+        //the entries stay for getLastMs()
+        for (ScopeStats& entry : stats) {
+            entry.totalMs = 0.0;
+            entry.maxMs = 0.0;
+            entry.count = 0;
+        }
+        framesResolved = 0;
+        framesDropped = 0;
+    }
+}
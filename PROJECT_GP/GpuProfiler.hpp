@@ -0,0 +1,109 @@
+#ifndef GpuProfiler_hpp
+#define GpuProfiler_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Nested GPU scopes timed with GL_TIMESTAMP queries (unlike GL_TIME_ELAPSED they may nest).
+    // Frames alternate between the two halves of a double-buffered pool, and a half is read back
+    // when it is about to be reused, so results arrive two frames after they were issued; a result that still
+    // isn't ready drops that frame instead of waiting
+    class GpuProfiler {
+
+    public:
+        struct ScopeStats {
+            //a scope's identity is its name, which must outlive the profiler (string literals)
+            const char* name;
+            int depth;
+            double totalMs;
+            double maxMs;
+            int count;
+            //newest result, kept across resetStats()
+            double lastMs;
+        };
+
+        //maxScopes per frame; the scopes past it are not timed
+        void init(int maxScopes);
+        void destroy();
+        bool isEnabled() const;
+
+        //one row per scope and frame: frame,scope,depth,ms
+        bool openCsv(const std::string& fileName);
+
+        void beginFrame();
+        void endFrame();
+        //reads back the half the next beginFrame() reuses; with keepFrameTimes that waits for the GPU,
+        //so a caller timing the CPU side of its frames calls this outside the timing
+        void collect();
+        void beginScope(const char* name);
+        void endScope();
+        //reads back the frames still in flight, waiting for them
+        void flush();
+
+        //keeps the GPU time of every frame, from its first timestamp to its last; frames are then
+        //waited for instead of dropped, so none is missing
+        void keepFrameTimes(bool keep);
+        const std::vector<double>& getFrameTimes() const;
+        void clearFrameTimes();
+
+        //averages since the last reset, in the order the scopes were first seen
+        const std::vector<ScopeStats>& getStats() const;
+        //the scope's newest result, 0 if it was never resolved
+        double getLastMs(const char* name) const;
+        int getFramesResolved() const;
+        int getFramesDropped() const;
+        void printStats() const;
+        void resetStats();
+
+    private:
+        static constexpr int POOL_FRAMES = 2;
+
+        struct Scope {
+            const char* name;
+            int depth;
+            int beginQuery;
+            int endQuery;
+        };
+
+        struct FrameQueries {
+            std::vector<GLuint> queries;
+            std::vector<Scope> scopes;
+            int used = 0;
+            long long frame = 0;
+            bool pending = false;
+        };
+
+        FrameQueries pool[POOL_FRAMES];
+        int current = 0;
+        long long frameNumber = 0;
+        int maxScopes = 0;
+        bool enabled = false;
+
+        //indices into pool[current].scopes of the scopes still open
+        std::vector<int> openScopes;
+
+        std::vector<ScopeStats> stats;
+        int framesResolved = 0;
+        int framesDropped = 0;
+        bool keepingFrameTimes = false;
+        std::vector<double> frameTimes;
+        FILE* csv = NULL;
+
+        //without wait, a frame whose results aren't there yet is dropped
+        void resolve(FrameQueries& frame, bool wait);
+        void record(const Scope& scope, double ms);
+    };
+}
+
+#endif /* GpuProfiler_hpp */
@@ -0,0 +1,359 @@
+#include "HiZBuffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    namespace {
+
+        //internal format of the source depth, a depth blit requires matching formats
+        GLenum sourceDepthFormat(GLuint sourceFramebuffer) {
+
+            GLenum attachment = sourceFramebuffer ? GL_DEPTH_ATTACHMENT : GL_DEPTH;
+            GLint depthBits = 0, stencilBits = 0, componentType = GL_UNSIGNED_NORMALIZED;
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFramebuffer);
+            glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, attachment, GL_FRAMEBUFFER_ATTACHMENT_DEPTH_SIZE, &depthBits);
+            glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, attachment, GL_FRAMEBUFFER_ATTACHMENT_STENCIL_SIZE, &stencilBits);
+            glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, attachment, GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE, &componentType);
+
+            if (componentType == GL_FLOAT) {
+                return stencilBits ? GL_DEPTH32F_STENCIL8 : GL_DEPTH_COMPONENT32F;
+            }
+            if (stencilBits) {
+                return GL_DEPTH24_STENCIL8;
+            }
+            if (depthBits >= 32) {
+                return GL_DEPTH_COMPONENT32;
+            }
+            return depthBits <= 16 ? GL_DEPTH_COMPONENT16 : GL_DEPTH_COMPONENT24;
+        }
+
+        bool hasStencil(GLenum depthFormat) {
+            return depthFormat == GL_DEPTH24_STENCIL8 || depthFormat == GL_DEPTH32F_STENCIL8;
+        }
+    }
+
+    void HiZBuffer::init() {
+
+        glGenFramebuffers(1, &depthFBO);
+        glGenFramebuffers(1, &pyramidFBO);
+        glGenVertexArrays(1, &fullScreenVAO);
+
+        //full-screen triangle from the deferred lighting pass
+        downsampleShader.loadShader(
+            "shaders/deferredLight.vert",
+            "shaders/hizDownsample.frag");
+    }
+
+    void HiZBuffer::destroy() {
+
+        destroyTargets();
+        glDeleteVertexArrays(1, &fullScreenVAO);
+        glDeleteFramebuffers(1, &pyramidFBO);
+        glDeleteFramebuffers(1, &depthFBO);
+        Shader::deleteProgram(downsampleShader.shaderProgram);
+    }
+
+    void HiZBuffer::createTargets(int width, int height, GLenum depthFormat) {
+
+        this->width = width;
+        this->height = height;
+        this->depthFormat = depthFormat;
+
+        //the pixel format/type only matter for the (absent) initial data, but have to fit the internal format
+        GLenum format = hasStencil(depthFormat) ? GL_DEPTH_STENCIL : GL_DEPTH_COMPONENT;
+        GLenum type = depthFormat == GL_DEPTH24_STENCIL8 ? GL_UNSIGNED_INT_24_8 :
+                      depthFormat == GL_DEPTH32F_STENCIL8 ? GL_FLOAT_32_UNSIGNED_INT_24_8_REV :
+                      depthFormat == GL_DEPTH_COMPONENT32F ? GL_FLOAT : GL_UNSIGNED_INT;
+
+        glGenTextures(1, &depthTexture);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, depthFormat, width, height, 0, format, type, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, hasStencil(depthFormat) ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT,
+            GL_TEXTURE_2D, depthTexture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+
+        //halve until the level is small enough to read back every frame
+        levelSizes.clear();
+        glm::ivec2 size(std::max(1, width / 2), std::max(1, height / 2));
+        levelSizes.push_back(size);
+        while (size.x > READBACK_MAX_WIDTH) {
+            size = glm::ivec2(std::max(1, size.x / 2), std::max(1, size.y / 2));
+            levelSizes.push_back(size);
+        }
+        readbackLevel = (int)levelSizes.size() - 1;
+
+        glGenTextures(1, &pyramidTexture);
+        glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+        for (int level = 0; level <= readbackLevel; level++) {
+            glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, levelSizes[level].x, levelSizes[level].y, 0, GL_RED, GL_FLOAT, NULL);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, readbackLevel);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        for (int i = 0; i < READBACK_BUFFERS; i++) {
+            glGenBuffers(1, &readbacks[i].buffer);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readbacks[i].buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, levelSizes[readbackLevel].x * levelSizes[readbackLevel].y * sizeof(float), NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    void HiZBuffer::destroyTargets() {
+
+        if (!depthTexture) {
+            return;
+        }
+
+        for (int i = 0; i < READBACK_BUFFERS; i++) {
+            if (readbacks[i].fence) {
+                glDeleteSync(readbacks[i].fence);
+                readbacks[i].fence = 0;
+            }
+            glDeleteBuffers(1, &readbacks[i].buffer);
+            readbacks[i].buffer = 0;
+        }
+
+        glDeleteTextures(1, &pyramidTexture);
+        glDeleteTextures(1, &depthTexture);
+        pyramidTexture = 0;
+        depthTexture = 0;
+    }
+
+    void HiZBuffer::downsample(GLuint sourceTexture, int sourceLevel, glm::ivec2 sourceSize, int targetLevel) {
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pyramidTexture, targetLevel);
+        glViewport(0, 0, levelSizes[targetLevel].x, levelSizes[targetLevel].y);
+
+        glBindTexture(GL_TEXTURE_2D, sourceTexture);
+        if (sourceTexture == pyramidTexture) {
+            //only the source level may be visible to the sampler, the target level is attached for writing
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, sourceLevel);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, sourceLevel);
+        }
+
+        glUniform1i(downsampleShader.getUniformLocation("sourceLevel"), sourceLevel);
+        glUniform2i(downsampleShader.getUniformLocation("sourceSize"), sourceSize.x, sourceSize.y);
+
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+
+    void HiZBuffer::capture(GLuint sourceFramebuffer, int width, int height, const glm::mat4& viewProjection) {
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLint polygonMode[2];
+        glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+        //not necessarily 0, offscreen windows render into a framebuffer object
+        GLint drawFramebuffer;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+
+        //the source changes size with the window and its depth format with the render path
+        GLenum format = sourceDepthFormat(sourceFramebuffer);
+        if (width != this->width || height != this->height || format != depthFormat) {
+            destroyTargets();
+            createTargets(width, height, format);
+            //the captures in flight went with the old targets
+            valid = false;
+        } else {
+            collectReadbacks();
+        }
+
+        //resolve the (multisampled) scene depth into the single-sample copy
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFramebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, depthFBO);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, pyramidFBO);
+        glDisable(GL_DEPTH_TEST);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+        downsampleShader.useShaderProgram();
+        glUniform1i(downsampleShader.getUniformLocation("sourceDepth"), 0);
+        glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(fullScreenVAO);
+
+        downsample(depthTexture, 0, glm::ivec2(width, height), 0);
+        for (int level = 1; level <= readbackLevel; level++) {
+            downsample(pyramidTexture, level - 1, levelSizes[level - 1], level);
+        }
+
+        glBindVertexArray(0);
+        glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, readbackLevel);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        //the last level is still attached, copy it into a PBO without waiting for it
+        Readback& readback = readbacks[nextReadback];
+        if (readback.fence) {
+            //not collected after READBACK_BUFFERS frames, give up on it
+            glDeleteSync(readback.fence);
+        }
+
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        glReadPixels(0, 0, levelSizes[readbackLevel].x, levelSizes[readbackLevel].y, GL_RED, GL_FLOAT, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readback.viewProjection = viewProjection;
+        readback.serial = ++captureSerial;
+        nextReadback = (nextReadback + 1) % READBACK_BUFFERS;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, drawFramebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glEnable(GL_DEPTH_TEST);
+        glPolygonMode(GL_FRONT_AND_BACK, polygonMode[0]);
+    }
+
+    void HiZBuffer::collectReadbacks() {
+
+        //oldest first, so the newest finished capture ends up in the CPU pyramid
+        for (int i = 0; i < READBACK_BUFFERS; i++) {
+
+            Readback& readback = readbacks[(nextReadback + i) % READBACK_BUFFERS];
+            if (!readback.fence) {
+                continue;
+            }
+
+            GLenum status = glClientWaitSync(readback.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+                continue;
+            }
+
+            glDeleteSync(readback.fence);
+            readback.fence = 0;
+
+            if (readback.serial < firstValidSerial) {
+                continue;
+            }
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+            const float* data = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,
+                levelSizes[readbackLevel].x * levelSizes[readbackLevel].y * sizeof(float), GL_MAP_READ_BIT);
+
+            if (data) {
+                buildCpuLevels(data);
+                cpuViewProjection = readback.viewProjection;
+                valid = true;
+            }
+
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+    }
+
+    void HiZBuffer::buildCpuLevels(const float* data) {
+
+        glm::ivec2 size = levelSizes[readbackLevel];
+
+        cpuLevelSizes.assign(1, size);
+        cpuLevels.resize(1);
+        cpuLevels[0].assign(data, data + size.x * size.y);
+
+        //continue the reduction down to 1x1, same rules as hizDownsample.frag
+        while (size.x > 1 || size.y > 1) {
+
+            glm::ivec2 next(std::max(1, size.x / 2), std::max(1, size.y / 2));
+            const std::vector<float>& source = cpuLevels.back();
+            std::vector<float> target(next.x * next.y, 0.0f);
+
+            for (int y = 0; y < size.y; y++) {
+                for (int x = 0; x < size.x; x++) {
+                    int targetIndex = std::min(y / 2, next.y - 1) * next.x + std::min(x / 2, next.x - 1);
+                    target[targetIndex] = std::max(target[targetIndex], source[y * size.x + x]);
+                }
+            }
+
+            cpuLevels.push_back(target);
+            cpuLevelSizes.push_back(next);
+            size = next;
+        }
+    }
+
+    void HiZBuffer::invalidate() {
+
+        valid = false;
+        firstValidSerial = captureSerial + 1;
+    }
+
+    bool HiZBuffer::isValid() const {
+        return valid;
+    }
+
+    bool HiZBuffer::isOccluded(glm::vec3 boxMin, glm::vec3 boxMax, const glm::mat4& modelMatrix) const {
+
+        if (!valid) {
+            return false;
+        }
+
+        glm::mat4 clipMatrix = cpuViewProjection * modelMatrix;
+
+        glm::vec2 rectMin(1e30f);
+        glm::vec2 rectMax(-1e30f);
+        float nearestDepth = 1.0f;
+
+        for (int i = 0; i < 8; i++) {
+
+            glm::vec3 corner((i & 1) ? boxMax.x : boxMin.x, (i & 2) ? boxMax.y : boxMin.y, (i & 4) ? boxMax.z : boxMin.z);
+            glm::vec4 clip = clipMatrix * glm::vec4(corner, 1.0f);
+
+            //the box reaches behind the camera
+            if (clip.w <= 1e-4f) {
+                return false;
+            }
+
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            rectMin = glm::min(rectMin, glm::vec2(ndc));
+            rectMax = glm::max(rectMax, glm::vec2(ndc));
+            nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+        }
+
+        //off screen in the captured view, nothing to test against
+        if (rectMax.x < -1.0f || rectMax.y < -1.0f || rectMin.x > 1.0f || rectMin.y > 1.0f) {
+            return false;
+        }
+
+        glm::ivec2 size = cpuLevelSizes[0];
+        glm::ivec2 texelMin(
+            std::max(0, (int)std::floor((rectMin.x * 0.5f + 0.5f) * size.x)),
+            std::max(0, (int)std::floor((rectMin.y * 0.5f + 0.5f) * size.y)));
+        glm::ivec2 texelMax(
+            std::min(size.x - 1, (int)std::floor((rectMax.x * 0.5f + 0.5f) * size.x)),
+            std::min(size.y - 1, (int)std::floor((rectMax.y * 0.5f + 0.5f) * size.y)));
+
+        //coarsest level where the rectangle still covers at most 4x4 texels
+        int level = 0;
+        while ((texelMax.x - texelMin.x > 3 || texelMax.y - texelMin.y > 3) && level + 1 < (int)cpuLevels.size()) {
+            level++;
+            glm::ivec2 levelSize = cpuLevelSizes[level];
+            texelMin = glm::ivec2(std::min(texelMin.x / 2, levelSize.x - 1), std::min(texelMin.y / 2, levelSize.y - 1));
+            texelMax = glm::ivec2(std::min(texelMax.x / 2, levelSize.x - 1), std::min(texelMax.y / 2, levelSize.y - 1));
+        }
+
+        const std::vector<float>& depths = cpuLevels[level];
+        int rowLength = cpuLevelSizes[level].x;
+
+        for (int y = texelMin.y; y <= texelMax.y; y++) {
+            for (int x = texelMin.x; x <= texelMax.x; x++) {
+                //something behind the occluders is visible here
+                if (depths[y * rowLength + x] >= nearestDepth) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+}
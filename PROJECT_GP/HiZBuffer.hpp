@@ -0,0 +1,89 @@
+#ifndef HiZBuffer_hpp
+#define HiZBuffer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include "Shader.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Hierarchical-Z occlusion culling against an earlier frame's depth.
+    // The depth buffer is reduced on the GPU (max of 2x2) down to a small level, read back
+    // asynchronously through PBOs and reduced further on the CPU, where the bounding boxes are tested.
+    class HiZBuffer {
+
+    public:
+        //the GPU reduction stops at the first level at most this wide, that level is read back
+        static constexpr int READBACK_MAX_WIDTH = 256;
+        static constexpr int READBACK_BUFFERS = 3;
+
+        void init();
+        void destroy();
+
+        //call after the frame's depth is complete; sourceFramebuffer holds it (0 = default framebuffer)
+        //at width x height, viewProjection is the matrix the depth was rendered with
+        //the targets follow the source's size and depth format, they are recreated when either changes
+        void capture(GLuint sourceFramebuffer, int width, int height, const glm::mat4& viewProjection);
+
+        //drops the current pyramid and the readbacks in flight, e.g. while the camera jumps
+        void invalidate();
+
+        bool isValid() const;
+
+        //true if the box (object space of modelMatrix) is hidden behind the captured depth
+        bool isOccluded(glm::vec3 boxMin, glm::vec3 boxMax, const glm::mat4& modelMatrix) const;
+
+    private:
+        int width = 0;
+        int height = 0;
+        GLenum depthFormat = GL_NONE;
+
+        //single-sample copy of the scene depth, in the source's depth format
+        GLuint depthFBO;
+        GLuint depthTexture = 0;
+
+        //R32F reduction chain, level 0 is half the screen size
+        GLuint pyramidTexture = 0;
+        GLuint pyramidFBO;
+        GLuint fullScreenVAO;
+        std::vector<glm::ivec2> levelSizes;
+        int readbackLevel;
+        gps::Shader downsampleShader;
+
+        struct Readback {
+            GLuint buffer = 0;
+            GLsync fence = 0;
+            glm::mat4 viewProjection;
+            //captures older than the last invalidate() are discarded
+            unsigned int serial = 0;
+        };
+        Readback readbacks[READBACK_BUFFERS];
+        int nextReadback = 0;
+        unsigned int captureSerial = 0;
+        unsigned int firstValidSerial = 0;
+
+        //CPU side pyramid built from the newest finished readback
+        std::vector<std::vector<float>> cpuLevels;
+        std::vector<glm::ivec2> cpuLevelSizes;
+        glm::mat4 cpuViewProjection;
+        bool valid = false;
+
+        void createTargets(int width, int height, GLenum depthFormat);
+        void destroyTargets();
+        void collectReadbacks();
+        void buildCpuLevels(const float* data);
+        void downsample(GLuint sourceTexture, int sourceLevel, glm::ivec2 sourceSize, int targetLevel);
+    };
+}
+
+#endif /* HiZBuffer_hpp */
@@ -0,0 +1,56 @@
+#include "InstanceBuffer.hpp"
+
+namespace gps {
+
+    void InstanceBuffer::init() {
+
+        glGenBuffers(1, &buffer);
+    }
+
+    void InstanceBuffer::destroy() {
+
+        glDeleteBuffers(1, &buffer);
+        count = 0;
+    }
+
+    void InstanceBuffer::upload(const std::vector<glm::mat4>& modelMatrices) {
+
+        count = (GLsizei)modelMatrices.size();
+        if (count == 0) {
+            return;
+        }
+
+        GLsizeiptr size = modelMatrices.size() * sizeof(glm::mat4);
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, &modelMatrices[0]);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void InstanceBuffer::bindAttributes() const {
+
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+        //a mat4 attribute is four vec4 columns in consecutive locations
+        for (GLuint column = 0; column < 4; column++) {
+            glEnableVertexAttribArray(FIRST_ATTRIBUTE + column);
+            glVertexAttribPointer(FIRST_ATTRIBUTE + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(FIRST_ATTRIBUTE + column, 1);
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void InstanceBuffer::unbindAttributes() {
+
+        for (GLuint column = 0; column < 4; column++) {
+            glVertexAttribDivisor(FIRST_ATTRIBUTE + column, 0);
+            glDisableVertexAttribArray(FIRST_ATTRIBUTE + column);
+        }
+    }
+
+    GLsizei InstanceBuffer::getCount() const {
+        return count;
+    }
+}
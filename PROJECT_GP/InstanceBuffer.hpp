@@ -0,0 +1,44 @@
+#ifndef InstanceBuffer_hpp
+#define InstanceBuffer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace gps {
+
+    // Model matrices of the copies drawn by Model3D::DrawInstanced, one mat4 per instance.
+    // Only rotation, uniform scale and translation: basic.vert uses their upper 3x3 for the normals
+    class InstanceBuffer {
+
+    public:
+        //the mat4 takes this attribute location and the next three, see shaders/instancing.glsl
+        static constexpr GLuint FIRST_ATTRIBUTE = 3;
+
+        void init();
+        void destroy();
+
+        //replaces the matrices; the previous storage is orphaned, so uploading between passes never stalls
+        void upload(const std::vector<glm::mat4>& modelMatrices);
+
+        //points the instance attributes of the bound vertex array at the buffer, advancing once per instance
+        void bindAttributes() const;
+        static void unbindAttributes();
+
+        GLsizei getCount() const;
+
+    private:
+        GLuint buffer = 0;
+        GLsizei count = 0;
+    };
+}
+
+#endif /* InstanceBuffer_hpp */
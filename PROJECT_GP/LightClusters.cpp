@@ -0,0 +1,245 @@
+#include "LightClusters.hpp"
+#include "Shader.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    void LightClusters::init() {
+
+        bindingVersion++;
+        glGenBuffers(1, &lightDataBuffer);
+        glGenBuffers(1, &clusterGridBuffer);
+        glGenBuffers(1, &lightIndexBuffer);
+
+        glGenTextures(1, &lightDataTexture);
+        glGenTextures(1, &clusterGridTexture);
+        glGenTextures(1, &lightIndexTexture);
+
+        lightData.reserve(MAX_LIGHTS * 3);
+        clusterGrid.resize(NUM_CLUSTERS * 2, 0);
+
+        //start with empty clusters so the shader reads valid data before the first update
+        std::vector<ClusterLight> noLights;
+        update(noLights, glm::mat4(1.0f));
+    }
+
+    void LightClusters::destroy() {
+
+        glDeleteTextures(1, &lightDataTexture);
+        glDeleteTextures(1, &clusterGridTexture);
+        glDeleteTextures(1, &lightIndexTexture);
+
+        glDeleteBuffers(1, &lightDataBuffer);
+        glDeleteBuffers(1, &clusterGridBuffer);
+        glDeleteBuffers(1, &lightIndexBuffer);
+    }
+
+    void LightClusters::setProjection(glm::mat4 projection, int viewportWidth, int viewportHeight, float nearPlane, float farPlane) {
+
+        bindingVersion++;
+        this->nearPlane = nearPlane;
+        this->farPlane = farPlane;
+        this->tileSize = glm::vec2((float)viewportWidth / TILES_X, (float)viewportHeight / TILES_Y);
+
+        clusterBounds.resize(NUM_CLUSTERS);
+
+        //a symmetric perspective maps view x to ndc x as x_ndc = P[0][0] * x / depth
+        float invScaleX = 1.0f / projection[0][0];
+        float invScaleY = 1.0f / projection[1][1];
+
+        for (int z = 0; z < SLICES_Z; z++) {
+
+            float sliceNear = nearPlane * std::pow(farPlane / nearPlane, (float)z / SLICES_Z);
+            float sliceFar = nearPlane * std::pow(farPlane / nearPlane, (float)(z + 1) / SLICES_Z);
+
+            for (int y = 0; y < TILES_Y; y++) {
+                for (int x = 0; x < TILES_X; x++) {
+
+                    float ndcX[2] = { -1.0f + 2.0f * x / TILES_X, -1.0f + 2.0f * (x + 1) / TILES_X };
+                    float ndcY[2] = { -1.0f + 2.0f * y / TILES_Y, -1.0f + 2.0f * (y + 1) / TILES_Y };
+                    float depths[2] = { sliceNear, sliceFar };
+
+                    ClusterBounds bounds;
+                    bounds.min = glm::vec3(1e30f);
+                    bounds.max = glm::vec3(-1e30f);
+
+                    for (int i = 0; i < 8; i++) {
+                        float depth = depths[(i >> 2) & 1];
+                        glm::vec3 corner(ndcX[i & 1] * depth * invScaleX, ndcY[(i >> 1) & 1] * depth * invScaleY, -depth);
+                        bounds.min = glm::min(bounds.min, corner);
+                        bounds.max = glm::max(bounds.max, corner);
+                    }
+
+                    clusterBounds[x + TILES_X * (y + TILES_Y * z)] = bounds;
+                }
+            }
+        }
+    }
+
+    // distance at which color * attenuation drops below lightCutoff
+    float LightClusters::computeLightRadius(const ClusterLight& light) const {
+
+        float maxChannel = std::max(light.color.x, std::max(light.color.y, light.color.z));
+        if (maxChannel <= 0.0f) {
+            return 0.0f;
+        }
+
+        //solve quadratic * d^2 + linear * d + constant = maxChannel / cutoff
+        float c = light.constant - maxChannel / lightCutoff;
+        if (light.quadratic > 0.0f) {
+            //no real root: a light too dim to ever reach the cutoff
+            float discriminant = light.linear * light.linear - 4.0f * light.quadratic * c;
+            if (discriminant < 0.0f) {
+                return 0.0f;
+            }
+            float radius = (-light.linear + std::sqrt(discriminant)) / (2.0f * light.quadratic);
+            return std::max(radius, 0.0f);
+        }
+        if (light.linear > 0.0f) {
+            return std::max(-c / light.linear, 0.0f);
+        }
+
+        //no falloff, the light reaches everything
+        return farPlane;
+    }
+
+    int LightClusters::depthToSlice(float depth) const {
+
+        float slice = std::log(depth / nearPlane) / std::log(farPlane / nearPlane) * SLICES_Z;
+        return std::min(std::max((int)slice, 0), SLICES_Z - 1);
+    }
+
+    void LightClusters::update(const std::vector<ClusterLight>& lights, glm::mat4 view) {
+
+        numLights = std::min((int)lights.size(), MAX_LIGHTS);
+
+        lightData.clear();
+        clusterLightPairs.clear();
+
+        for (int i = 0; i < numLights; i++) {
+
+            const ClusterLight& light = lights[i];
+            float radius = computeLightRadius(light);
+
+            //3 texels per light, unpacked by fetchPointLight() in basic.frag
+            lightData.push_back(glm::vec4(light.position, radius));
+            lightData.push_back(glm::vec4(light.color, light.constant));
+            lightData.push_back(glm::vec4(light.linear, light.quadratic, (float)light.shadowLayer, 0.0f));
+
+            if (radius <= 0.0f || clusterBounds.empty()) {
+                continue;
+            }
+
+            glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+            float depth = -center.z;
+
+            if (depth + radius < nearPlane || depth - radius > farPlane) {
+                continue;
+            }
+
+            int firstSlice = depthToSlice(std::max(depth - radius, nearPlane));
+            int lastSlice = depthToSlice(std::min(depth + radius, farPlane));
+
+            for (int z = firstSlice; z <= lastSlice; z++) {
+                for (int tile = 0; tile < TILES_X * TILES_Y; tile++) {
+
+                    int cluster = tile + TILES_X * TILES_Y * z;
+                    const ClusterBounds& bounds = clusterBounds[cluster];
+
+                    //sphere vs box: distance from the center to the closest point of the box
+                    glm::vec3 closest = glm::clamp(center, bounds.min, bounds.max);
+                    glm::vec3 delta = closest - center;
+
+                    if (glm::dot(delta, delta) <= radius * radius) {
+                        clusterLightPairs.push_back(std::make_pair((uint32_t)cluster, (uint32_t)i));
+                    }
+                }
+            }
+        }
+
+        //counting sort of the (cluster, light) pairs into per cluster (offset, count) ranges
+        std::fill(clusterGrid.begin(), clusterGrid.end(), 0);
+
+        for (size_t i = 0; i < clusterLightPairs.size(); i++) {
+            clusterGrid[clusterLightPairs[i].first * 2 + 1]++;
+        }
+
+        uint32_t offset = 0;
+        for (int c = 0; c < NUM_CLUSTERS; c++) {
+            clusterGrid[c * 2] = offset;
+            offset += clusterGrid[c * 2 + 1];
+            clusterGrid[c * 2 + 1] = 0;
+        }
+
+        lightIndices.resize(std::max<size_t>(clusterLightPairs.size(), 1));
+
+        for (size_t i = 0; i < clusterLightPairs.size(); i++) {
+            uint32_t cluster = clusterLightPairs[i].first;
+            lightIndices[clusterGrid[cluster * 2] + clusterGrid[cluster * 2 + 1]++] = clusterLightPairs[i].second;
+        }
+
+        if (lightData.empty()) {
+            lightData.push_back(glm::vec4(0.0f));
+        }
+
+        uploadTextureBuffer(lightDataBuffer, lightDataTexture, GL_RGBA32F, lightData.data(), lightData.size() * sizeof(glm::vec4));
+        uploadTextureBuffer(clusterGridBuffer, clusterGridTexture, GL_RG32UI, clusterGrid.data(), clusterGrid.size() * sizeof(uint32_t));
+        uploadTextureBuffer(lightIndexBuffer, lightIndexTexture, GL_R32UI, lightIndices.data(), lightIndices.size() * sizeof(uint32_t));
+    }
+
+    void LightClusters::uploadTextureBuffer(GLuint buffer, GLuint texture, GLenum format, const void* data, size_t size) {
+
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        //orphan the previous storage so we never wait on a frame still reading it
+        glBufferData(GL_TEXTURE_BUFFER, size, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void LightClusters::bind(GLuint shaderProgram) {
+
+        glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, lightDataTexture);
+        glUniform1i(Shader::getUniformLocation(shaderProgram, "lightData"), FIRST_TEXTURE_UNIT);
+
+        glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + 1);
+        glBindTexture(GL_TEXTURE_BUFFER, clusterGridTexture);
+        glUniform1i(Shader::getUniformLocation(shaderProgram, "clusterGrid"), FIRST_TEXTURE_UNIT + 1);
+
+        glActiveTexture(GL_TEXTURE0 + FIRST_TEXTURE_UNIT + 2);
+        glBindTexture(GL_TEXTURE_BUFFER, lightIndexTexture);
+        glUniform1i(Shader::getUniformLocation(shaderProgram, "lightIndices"), FIRST_TEXTURE_UNIT + 2);
+
+        glActiveTexture(GL_TEXTURE0);
+
+        //slice = log(depth) * scale - bias, same mapping as depthToSlice()
+        float scale = SLICES_Z / std::log(farPlane / nearPlane);
+        float bias = SLICES_Z * std::log(nearPlane) / std::log(farPlane / nearPlane);
+
+        glUniform3i(Shader::getUniformLocation(shaderProgram, "clusterDims"), TILES_X, TILES_Y, SLICES_Z);
+        glUniform2f(Shader::getUniformLocation(shaderProgram, "clusterTileSize"), tileSize.x, tileSize.y);
+        glUniform2f(Shader::getUniformLocation(shaderProgram, "clusterZParams"), scale, bias);
+    }
+
+    unsigned int LightClusters::getBindingVersion() const {
+        return bindingVersion;
+    }
+
+    int LightClusters::getNumLights() const {
+        return numLights;
+    }
+
+    int LightClusters::getNumLightIndices() const {
+        return (int)clusterLightPairs.size();
+    }
+
+    float LightClusters::getLightRadius(int index) const {
+        return lightData[index * 3].w;
+    }
+}
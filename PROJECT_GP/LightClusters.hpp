@@ -0,0 +1,99 @@
+#ifndef LightClusters_hpp
+#define LightClusters_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace gps {
+
+    struct ClusterLight {
+
+        glm::vec3 position;
+        glm::vec3 color;
+        float constant;
+        float linear;
+        float quadratic;
+        //layer in the shadow map array, -1 if the light casts no shadow
+        int shadowLayer;
+    };
+
+    // Clustered forward lighting: the view frustum is split into a TILES_X x TILES_Y x SLICES_Z grid
+    // (exponential depth slices), every point light is assigned on the CPU to the clusters its
+    // sphere of influence touches, and the result is exposed to basic.frag through texture buffers
+    class LightClusters {
+
+    public:
+        static constexpr int TILES_X = 16;
+        static constexpr int TILES_Y = 9;
+        static constexpr int SLICES_Z = 24;
+        static constexpr int NUM_CLUSTERS = TILES_X * TILES_Y * SLICES_Z;
+        static constexpr int MAX_LIGHTS = 1024;
+
+        //first of the three consecutive texture units used by the cluster buffers
+        static constexpr GLuint FIRST_TEXTURE_UNIT = 4;
+
+        //intensity below which a light is treated as not reaching a point
+        float lightCutoff = 1.0f / 256.0f;
+
+        void init();
+        void destroy();
+
+        //rebuilds the view-space cluster bounds; call whenever the projection or viewport changes
+        void setProjection(glm::mat4 projection, int viewportWidth, int viewportHeight, float nearPlane, float farPlane);
+
+        //assigns the lights to clusters for the given view and uploads the result
+        void update(const std::vector<ClusterLight>& lights, glm::mat4 view);
+
+        //binds the buffers and the grid parameters to the program (must be in use)
+        void bind(GLuint shaderProgram);
+
+        int getNumLights() const;
+        int getNumLightIndices() const;
+
+        //radius of influence computed by the last update(), 0 if the light reaches nothing
+        float getLightRadius(int index) const;
+        //changes whenever bind() would send something else: new textures or a new projection
+        unsigned int getBindingVersion() const;
+
+    private:
+        struct ClusterBounds {
+            glm::vec3 min;
+            glm::vec3 max;
+        };
+
+        std::vector<ClusterBounds> clusterBounds;
+
+        float nearPlane = 0.1f;
+        float farPlane = 20.0f;
+        glm::vec2 tileSize = glm::vec2(1.0f);
+
+        //CPU staging, reused every frame
+        std::vector<glm::vec4> lightData;
+        std::vector<std::pair<uint32_t, uint32_t>> clusterLightPairs;
+        std::vector<uint32_t> clusterGrid;
+        std::vector<uint32_t> lightIndices;
+        int numLights = 0;
+        unsigned int bindingVersion = 0;
+
+        GLuint lightDataBuffer = 0, lightDataTexture = 0;
+        GLuint clusterGridBuffer = 0, clusterGridTexture = 0;
+        GLuint lightIndexBuffer = 0, lightIndexTexture = 0;
+
+        float computeLightRadius(const ClusterLight& light) const;
+        int depthToSlice(float depth) const;
+        void uploadTextureBuffer(GLuint buffer, GLuint texture, GLenum format, const void* data, size_t size);
+    };
+}
+
+#endif /* LightClusters_hpp */
@@ -0,0 +1,79 @@
+#include "LinearArena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace gps {
+
+    LinearArena::LinearArena(size_t blockSize) : blockSize(blockSize) {
+    }
+
+    LinearArena::~LinearArena() {
+        release();
+    }
+
+    void* LinearArena::allocate(size_t size, size_t alignment) {
+
+        while (currentBlock < blocks.size()) {
+
+            Block& block = blocks[currentBlock];
+            uintptr_t start = (uintptr_t)block.data + offset;
+            size_t padding = (alignment - start % alignment) % alignment;
+
+            if (offset + padding + size <= block.size) {
+                offset += padding + size;
+                bytesUsed += padding + size;
+                peakBytes = std::max(peakBytes, bytesUsed);
+                return (void*)(start + padding);
+            }
+
+            //what is left of this block is wasted, move on to the next one
+            currentBlock++;
+            offset = 0;
+        }
+
+        //out of blocks: a new one, big enough for oversized requests
+        Block block;
+        block.size = std::max(blockSize, size + alignment);
+        block.data = (char*)std::malloc(block.size);
+        if (block.data == NULL) {
+            throw std::bad_alloc();
+        }
+
+        blocks.push_back(block);
+        currentBlock = blocks.size() - 1;
+        offset = 0;
+
+        return allocate(size, alignment);
+    }
+
+    void LinearArena::reset() {
+
+        currentBlock = 0;
+        offset = 0;
+        bytesUsed = 0;
+    }
+
+    void LinearArena::release() {
+
+        for (size_t i = 0; i < blocks.size(); i++) {
+            std::free(blocks[i].data);
+        }
+        blocks.clear();
+        reset();
+    }
+
+    size_t LinearArena::getBytesUsed() const {
+        return bytesUsed;
+    }
+
+    size_t LinearArena::getPeakBytes() const {
+        return peakBytes;
+    }
+
+    size_t LinearArena::getBlockCount() const {
+        return blocks.size();
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef LinearArena_hpp
+#define LinearArena_hpp
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // Bump allocator for short-lived data: allocations only move a pointer forward, nothing is freed
+    // individually, and reset() hands the whole arena back at once (keeping its blocks for reuse)
+    class LinearArena {
+
+    public:
+        static constexpr size_t DEFAULT_BLOCK_SIZE = 4 * 1024 * 1024;
+
+        explicit LinearArena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+        ~LinearArena();
+
+        LinearArena(const LinearArena&) = delete;
+        LinearArena& operator=(const LinearArena&) = delete;
+
+        void* allocate(size_t size, size_t alignment);
+
+        //forgets every allocation, the blocks stay allocated for the next use
+        void reset();
+        //frees the blocks too
+        void release();
+
+        size_t getBytesUsed() const;
+        size_t getPeakBytes() const;
+        size_t getBlockCount() const;
+
+    private:
+        struct Block {
+            char* data;
+            size_t size;
+        };
+
+        std::vector<Block> blocks;
+        size_t blockSize;
+        size_t currentBlock = 0;
+        size_t offset = 0;
+
+        size_t bytesUsed = 0;
+        size_t peakBytes = 0;
+    };
+
+    // STL allocator on top of a LinearArena; deallocate is a no-op, so reserve() containers up front
+    template <typename T>
+    class ArenaAllocator {
+
+    public:
+        typedef T value_type;
+
+        explicit ArenaAllocator(LinearArena& arena) : arena(&arena) {}
+
+        template <typename U>
+        ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+        T* allocate(size_t count) {
+            return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T*, size_t) {}
+
+        template <typename U>
+        bool operator==(const ArenaAllocator<U>& other) const {
+            return arena == other.arena;
+        }
+
+        template <typename U>
+        bool operator!=(const ArenaAllocator<U>& other) const {
+            return arena != other.arena;
+        }
+
+        LinearArena* arena;
+    };
+
+    template <typename T>
+    using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+}
+
+#endif /* LinearArena_hpp */
@@ -1,47 +1,191 @@
 #include "Mesh.hpp"
+#include "VertexPacker.hpp"
+
+#include <utility>
+
 namespace gps {
 
 	/* Mesh Constructor */
-	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures) {
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
+		: Mesh(std::move(vertices), std::move(indices), std::move(textures), std::vector<LodIndices>(), false) {
+	}
 
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+	/* Mesh Constructor with simplified index buffers and an optional packed vertex format */
+	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+		const std::vector<LodIndices>& lodIndices, bool packVertices) {
 
-		this->setupMesh();
+		// the arguments are the caller's copies (or moved in), take them over instead of copying again
+		this->vertices = std::move(vertices);
+		this->indices = std::move(indices);
+		this->textures = std::move(textures);
+		this->vertexCount = this->vertices.size();
+		this->indexCount = this->indices.size();
+
+		this->setupMesh(lodIndices, packVertices);
 	}
 
 	Buffers Mesh::getBuffers() {
 	    return this->buffers;
 	}
 
+	void Mesh::ReleaseCpuData() {
+
+		// swap with empty vectors, clear() would keep the capacity
+		std::vector<Vertex>().swap(this->vertices);
+		std::vector<GLuint>().swap(this->indices);
+	}
+
+	size_t Mesh::GetCpuBytes() const {
+
+		return this->vertices.capacity() * sizeof(Vertex)
+			+ this->indices.capacity() * sizeof(GLuint)
+			+ this->lods.capacity() * sizeof(Lod)
+			+ this->meshlets.capacity() * sizeof(Meshlet)
+			+ (this->meshletSpheres.centerX.capacity() + this->meshletSpheres.centerY.capacity()
+				+ this->meshletSpheres.centerZ.capacity() + this->meshletSpheres.radius.capacity()) * sizeof(float);
+	}
+
+	size_t Mesh::GetGpuBytes() const {
+
+		return (size_t)(this->vertexBufferBytes + this->indexBufferBytes);
+	}
+
+	bool Mesh::HasTexture(const std::string& type) const {
+
+		for (const Texture& texture : this->textures)
+			if (texture.type == type)
+				return true;
+		return false;
+	}
+
 	/* Mesh drawing function - also applies associated textures */
 	void Mesh::Draw(gps::Shader shader)	{
 
+		Draw(shader, 0);
+	}
+
+	void Mesh::Draw(gps::Shader shader, int lod) {
+
 		shader.useShaderProgram();
+		setDequantization(shader);
+		bindTextures(shader);
+
+		glBindVertexArray(this->buffers.VAO);
+		glDrawElements(GL_TRIANGLES, this->lods[lod].indexCount, GL_UNSIGNED_INT, (GLvoid*)this->lods[lod].indexOffset);
+		glBindVertexArray(0);
+
+		unbindTextures();
+	}
+
+	void Mesh::Draw(gps::Shader shader, const DrawRanges& ranges) {
+
+		if (ranges.counts.empty())
+			return;
+
+		shader.useShaderProgram();
+		setDequantization(shader);
+		bindTextures(shader);
+
+		glBindVertexArray(this->buffers.VAO);
+		glMultiDrawElements(GL_TRIANGLES, ranges.counts.data(), GL_UNSIGNED_INT, ranges.offsets.data(), (GLsizei)ranges.counts.size());
+		glBindVertexArray(0);
+
+		unbindTextures();
+	}
+
+	void Mesh::setDequantization(gps::Shader shader) {
+
+		if (!this->packedVertices)
+			return;
+
+		glUniform3fv(shader.getUniformLocation("positionScale"), 1, &this->positionScale[0]);
+		glUniform3fv(shader.getUniformLocation("positionBias"), 1, &this->positionBias[0]);
+	}
+
+	void Mesh::bindTextures(gps::Shader shader) {
 
 		//set textures
 		for (GLuint i = 0; i < textures.size(); i++) {
 
 			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
+			glUniform1i(shader.getUniformLocation(this->textures[i].type.c_str()), i);
 			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
 		}
+	}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, (GLsizei)this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+	void Mesh::unbindTextures() {
 
         for(GLuint i = 0; i < this->textures.size(); i++) {
 
             glActiveTexture(GL_TEXTURE0 + i);
             glBindTexture(GL_TEXTURE_2D, 0);
         }
+	}
+
+	/* Mesh drawing function for depth-only passes - skips the texture binds */
+	void Mesh::DrawDepth(gps::Shader shader) {
+
+		DrawDepth(shader, 0);
+	}
 
-    }
+	void Mesh::DrawDepth(gps::Shader shader, int lod) {
+
+		shader.useShaderProgram();
+		setDequantization(shader);
+
+		glBindVertexArray(this->buffers.VAO);
+		glDrawElements(GL_TRIANGLES, this->lods[lod].indexCount, GL_UNSIGNED_INT, (GLvoid*)this->lods[lod].indexOffset);
+		glBindVertexArray(0);
+	}
+
+	void Mesh::DrawDepth(gps::Shader shader, const DrawRanges& ranges) {
+
+		if (ranges.counts.empty())
+			return;
+
+		shader.useShaderProgram();
+		setDequantization(shader);
+
+		glBindVertexArray(this->buffers.VAO);
+		glMultiDrawElements(GL_TRIANGLES, ranges.counts.data(), GL_UNSIGNED_INT, ranges.offsets.data(), (GLsizei)ranges.counts.size());
+		glBindVertexArray(0);
+	}
+
+	void Mesh::DrawInstanced(gps::Shader shader, int lod, const InstanceBuffer& instances) {
+
+		if (instances.getCount() == 0)
+			return;
+
+		shader.useShaderProgram();
+		setDequantization(shader);
+		bindTextures(shader);
+
+		glBindVertexArray(this->buffers.VAO);
+		instances.bindAttributes();
+		glDrawElementsInstanced(GL_TRIANGLES, this->lods[lod].indexCount, GL_UNSIGNED_INT, (GLvoid*)this->lods[lod].indexOffset, instances.getCount());
+		InstanceBuffer::unbindAttributes();
+		glBindVertexArray(0);
+
+		unbindTextures();
+	}
+
+	void Mesh::DrawDepthInstanced(gps::Shader shader, int lod, const InstanceBuffer& instances) {
+
+		if (instances.getCount() == 0)
+			return;
+
+		shader.useShaderProgram();
+		setDequantization(shader);
+
+		glBindVertexArray(this->buffers.VAO);
+		instances.bindAttributes();
+		glDrawElementsInstanced(GL_TRIANGLES, this->lods[lod].indexCount, GL_UNSIGNED_INT, (GLvoid*)this->lods[lod].indexOffset, instances.getCount());
+		InstanceBuffer::unbindAttributes();
+		glBindVertexArray(0);
+	}
 
 	// Initializes all the buffer objects/arrays
-	void Mesh::setupMesh() {
+	void Mesh::setupMesh(const std::vector<LodIndices>& lodIndices, bool packVertices) {
 
 		// Create buffers/arrays
 		glGenVertexArrays(1, &this->buffers.VAO);
@@ -51,21 +195,64 @@ namespace gps {
 		glBindVertexArray(this->buffers.VAO);
 		// Load data into vertex buffers
 		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+
+		std::vector<PackedVertex> packed;
+		if (packVertices) {
+
+			VertexPacker::pack(this->vertices, packed, this->positionScale, this->positionBias, this->quantizationError);
+			this->packedVertices = true;
+			this->vertexBufferBytes = packed.size() * sizeof(PackedVertex);
+			glBufferData(GL_ARRAY_BUFFER, this->vertexBufferBytes, &packed[0], GL_STATIC_DRAW);
+		}
+		else {
+
+			this->vertexBufferBytes = this->vertices.size() * sizeof(Vertex);
+			glBufferData(GL_ARRAY_BUFFER, this->vertexBufferBytes, &this->vertices[0], GL_STATIC_DRAW);
+		}
+
+		// All levels of detail share one element buffer, the full mesh first
+		Lod full = { (GLsizei)this->indices.size(), 0, 0.0f };
+		this->lods.assign(1, full);
+
+		GLsizeiptr indexBytes = this->indices.size() * sizeof(GLuint);
+		for (size_t i = 0; i < lodIndices.size(); i++) {
+
+			Lod lod = { (GLsizei)lodIndices[i].indices.size(), indexBytes, lodIndices[i].error };
+			this->lods.push_back(lod);
+			indexBytes += lodIndices[i].indices.size() * sizeof(GLuint);
+		}
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+		this->indexBufferBytes = indexBytes;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, NULL, GL_STATIC_DRAW);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, this->indices.size() * sizeof(GLuint), &this->indices[0]);
+
+		for (size_t i = 0; i < lodIndices.size(); i++)
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, this->lods[i + 1].indexOffset, lodIndices[i].indices.size() * sizeof(GLuint), &lodIndices[i].indices[0]);
 
 		// Set the vertex attribute pointers
-		// Vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-		// Vertex Normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-		// Vertex Texture Coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+		if (packVertices) {
+
+			// Positions and normals are normalized integers, decoded in shaders/packedVertex.glsl
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, position));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, normal));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, texCoords));
+		}
+		else {
+
+			// Vertex Positions
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+			// Vertex Normals
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+			// Vertex Texture Coords
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+		}
 
 		glBindVertexArray(0);
 	}
@@ -12,6 +12,8 @@
 #include <glm/glm.hpp>
 
 #include "Shader.hpp"
+#include "Frustum.hpp"
+#include "InstanceBuffer.hpp"
 
 #include <string>
 #include <vector>
@@ -41,6 +43,54 @@ namespace gps {
         glm::vec3 specular;
     };
 
+    // object space bounds, computed when the model is read
+    struct Bounds {
+        glm::vec3 min;
+        glm::vec3 max;
+        glm::vec3 center;
+        float radius;
+    };
+
+    // largest difference between a vertex and what the shader decodes from its packed form (see gps::VertexPacker)
+    struct QuantizationError {
+        float position = 0.0f;
+        float normalDegrees = 0.0f;
+        float texCoords = 0.0f;
+    };
+
+    // a simplified copy of a mesh's index buffer, indexing the same vertices
+    struct LodIndices {
+        std::vector<GLuint> indices;
+        //largest object space deviation from the full mesh
+        float error;
+    };
+
+    // where one level of detail lives in the mesh's element buffer; level 0 is the full mesh
+    struct Lod {
+        GLsizei indexCount;
+        GLsizeiptr indexOffset;
+        float error;
+    };
+
+    // a cluster of up to 64 vertices / 124 triangles, contiguous in the full detail index range
+    struct Meshlet {
+        GLuint firstIndex;
+        GLsizei indexCount;
+        //every triangle normal is within the cone; coneCutoff is the sine of its half angle (> 1 never culls)
+        glm::vec3 coneAxis;
+        float coneCutoff;
+    };
+
+    // index ranges for glMultiDrawElements
+    struct DrawRanges {
+        std::vector<GLsizei> counts;
+        std::vector<const GLvoid*> offsets;
+
+        void clear();
+        //appends indexCount indices from firstIndex, merged with the previous range when they touch
+        void add(GLuint firstIndex, GLsizei indexCount);
+    };
+
     struct Buffers {
         GLuint VAO;
         GLuint VBO;
@@ -50,22 +100,73 @@ namespace gps {
     class Mesh {
 
     public:
+        // empty after ReleaseCpuData(), the GL buffers hold the only copy then
         std::vector<Vertex> vertices;
         std::vector<GLuint> indices;
         std::vector<Texture> textures;
+        Bounds bounds;
+        // full detail counts, kept when the CPU copies are released
+        size_t vertexCount = 0;
+        size_t indexCount = 0;
+        std::vector<Lod> lods;
+        std::vector<Meshlet> meshlets;
+        BoundingSpheres meshletSpheres;
+
+        // set when the GPU copy uses gps::PackedVertex, positions decode as positionBias + positionScale * stored
+        bool packedVertices = false;
+        glm::vec3 positionScale = glm::vec3(1.0f);
+        glm::vec3 positionBias = glm::vec3(0.0f);
+        QuantizationError quantizationError;
 
 	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
 
+	    // lodIndices are stored after the full index buffer, coarsest last;
+	    // packVertices uploads gps::PackedVertex instead, for shaders built with PACKED_VERTICES
+	    Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures,
+	        const std::vector<LodIndices>& lodIndices, bool packVertices);
+
 	    Buffers getBuffers();
 
+	    // Frees vertices and indices once they are uploaded; bounds, counts, lods and meshlets stay
+	    void ReleaseCpuData();
+
+	    // Bytes held in RAM by the mesh and in its GL buffers
+	    size_t GetCpuBytes() const;
+	    size_t GetGpuBytes() const;
+
+	    // True if one of the textures is bound to the sampler of that name, e.g. "specularTexture"
+	    bool HasTexture(const std::string& type) const;
+
 	    void Draw(gps::Shader shader);
 
+	    // Positions only - no texture binds, for depth-only passes
+	    void DrawDepth(gps::Shader shader);
+
+	    void Draw(gps::Shader shader, int lod);
+	    void DrawDepth(gps::Shader shader, int lod);
+
+	    // Only the given ranges of the full detail index buffer, e.g. the meshlets that survived culling
+	    void Draw(gps::Shader shader, const DrawRanges& ranges);
+	    void DrawDepth(gps::Shader shader, const DrawRanges& ranges);
+
+	    // One copy per matrix in instances, in a single draw call
+	    void DrawInstanced(gps::Shader shader, int lod, const InstanceBuffer& instances);
+	    void DrawDepthInstanced(gps::Shader shader, int lod, const InstanceBuffer& instances);
+
     private:
         /*  Render data  */
         Buffers buffers;
+        GLsizeiptr vertexBufferBytes = 0;
+        GLsizeiptr indexBufferBytes = 0;
 
 	    // Initializes all the buffer objects/arrays
-	    void setupMesh();
+	    void setupMesh(const std::vector<LodIndices>& lodIndices, bool packVertices);
+
+	    // Sends the packed position scale and bias (program must be in use)
+	    void setDequantization(gps::Shader shader);
+
+	    void bindTextures(gps::Shader shader);
+	    void unbindTextures();
 
     };
 
@@ -0,0 +1,359 @@
+#include "MeshSimplifier.hpp"
+#include "CpuProfiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+
+namespace gps {
+
+    namespace {
+
+        // symmetric 4x4 error quadric, upper triangle
+        struct Quadric {
+
+            double a[10] = { 0.0 };
+
+            void addPlane(glm::vec3 normal, float distance) {
+
+                double nx = normal.x, ny = normal.y, nz = normal.z, d = distance;
+                a[0] += nx * nx; a[1] += nx * ny; a[2] += nx * nz; a[3] += nx * d;
+                a[4] += ny * ny; a[5] += ny * nz; a[6] += ny * d;
+                a[7] += nz * nz; a[8] += nz * d;
+                a[9] += d * d;
+            }
+
+            void add(const Quadric& other) {
+
+                for (int i = 0; i < 10; i++) {
+                    a[i] += other.a[i];
+                }
+            }
+
+            //sum of squared distances from p to the accumulated planes
+            double evaluate(glm::vec3 p) const {
+
+                double x = p.x, y = p.y, z = p.z;
+                return a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x
+                    + a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y
+                    + a[7] * z * z + 2.0 * a[8] * z
+                    + a[9];
+            }
+        };
+
+        struct Collapse {
+
+            double cost;
+            uint32_t from;
+            uint32_t to;
+            //entries are stale once the neighbourhood of from changed
+            uint32_t version;
+
+            bool operator>(const Collapse& other) const {
+                return cost > other.cost;
+            }
+        };
+
+        // hashes a run of floats bitwise, for welding exactly equal vertices
+        template <size_t FloatCount>
+        struct FloatKeyHash {
+
+            size_t operator()(const float* key) const {
+
+                uint32_t hash = 2166136261u;
+                const unsigned char* bytes = (const unsigned char*)key;
+                for (size_t i = 0; i < FloatCount * sizeof(float); i++) {
+                    hash = (hash ^ bytes[i]) * 16777619u;
+                }
+                return hash;
+            }
+        };
+
+        template <size_t FloatCount>
+        struct FloatKeyEqual {
+
+            bool operator()(const float* a, const float* b) const {
+                return std::memcmp(a, b, FloatCount * sizeof(float)) == 0;
+            }
+        };
+
+        glm::vec3 triangleNormal(glm::vec3 a, glm::vec3 b, glm::vec3 c) {
+            return glm::cross(b - a, c - a);
+        }
+    }
+
+    std::vector<LodIndices> MeshSimplifier::buildLods(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, int levels, LinearArena& arena) {
+        PROFILE_ZONE("MeshSimplifier::buildLods");
+
+        std::vector<LodIndices> lods;
+        if (levels <= 0 || indices.size() < 3) {
+            return lods;
+        }
+
+        static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex is expected to be 8 tightly packed floats");
+
+        //weld exactly equal vertices (the OBJ reader emits one vertex per face corner)
+        //every temporary lives in the arena, sized up front where the final size is known
+        ArenaAllocator<char> alloc(arena);
+
+        std::unordered_map<const float*, uint32_t, FloatKeyHash<8>, FloatKeyEqual<8>, ArenaAllocator<std::pair<const float* const, uint32_t>>>
+            uniqueVertices(vertices.size(), FloatKeyHash<8>(), FloatKeyEqual<8>(), alloc);
+        std::unordered_map<const float*, uint32_t, FloatKeyHash<3>, FloatKeyEqual<3>, ArenaAllocator<std::pair<const float* const, uint32_t>>>
+            positionGroups(vertices.size(), FloatKeyHash<3>(), FloatKeyEqual<3>(), alloc);
+
+        ArenaVector<uint32_t> uniqueOf(vertices.size(), 0, alloc);
+        ArenaVector<GLuint> representative(alloc);
+        ArenaVector<glm::vec3> positions(alloc);
+        ArenaVector<uint32_t> groupOf(alloc);
+        ArenaVector<uint32_t> groupSize(alloc);
+        representative.reserve(vertices.size());
+        positions.reserve(vertices.size());
+        groupOf.reserve(vertices.size());
+        groupSize.reserve(vertices.size());
+
+        for (size_t i = 0; i < vertices.size(); i++) {
+
+            const float* key = (const float*)&vertices[i];
+            auto inserted = uniqueVertices.insert(std::make_pair(key, (uint32_t)representative.size()));
+
+            if (inserted.second) {
+                representative.push_back((GLuint)i);
+                positions.push_back(vertices[i].Position);
+
+                auto group = positionGroups.insert(std::make_pair((const float*)&vertices[i].Position, (uint32_t)groupSize.size()));
+                if (group.second) {
+                    groupSize.push_back(0);
+                }
+                groupOf.push_back(group.first->second);
+                groupSize[group.first->second]++;
+            }
+
+            uniqueOf[i] = inserted.first->second;
+        }
+
+        size_t vertexCount = representative.size();
+
+        //triangles in welded indices, dropping the degenerate ones
+        ArenaVector<uint32_t> triangles(alloc);
+        triangles.reserve(indices.size());
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+
+            uint32_t a = uniqueOf[indices[i]], b = uniqueOf[indices[i + 1]], c = uniqueOf[indices[i + 2]];
+            if (groupOf[a] == groupOf[b] || groupOf[b] == groupOf[c] || groupOf[a] == groupOf[c]) {
+                continue;
+            }
+            triangles.push_back(a);
+            triangles.push_back(b);
+            triangles.push_back(c);
+        }
+
+        size_t triangleCount = triangles.size() / 3;
+        if (triangleCount < 8) {
+            return lods;
+        }
+
+        //border edges (one triangle) and non-manifold edges (more than two), counted on positions
+        std::unordered_map<uint64_t, uint32_t, std::hash<uint64_t>, std::equal_to<uint64_t>, ArenaAllocator<std::pair<const uint64_t, uint32_t>>>
+            edgeUse(triangles.size(), std::hash<uint64_t>(), std::equal_to<uint64_t>(), alloc);
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (int e = 0; e < 3; e++) {
+                uint64_t g0 = groupOf[triangles[t * 3 + e]], g1 = groupOf[triangles[t * 3 + (e + 1) % 3]];
+                edgeUse[(std::min(g0, g1) << 32) | std::max(g0, g1)]++;
+            }
+        }
+
+        ArenaVector<uint8_t> groupLocked(groupSize.size(), 0, alloc);
+        for (auto& edge : edgeUse) {
+            if (edge.second != 2) {
+                groupLocked[edge.first >> 32] = 1;
+                groupLocked[edge.first & 0xffffffffu] = 1;
+            }
+        }
+
+        ArenaVector<uint8_t> locked(vertexCount, 0, alloc);
+        for (size_t v = 0; v < vertexCount; v++) {
+            //a seam vertex moving would tear the attribute discontinuity open
+            locked[v] = groupLocked[groupOf[v]] || groupSize[groupOf[v]] > 1;
+        }
+
+        //plane quadrics and vertex -> triangle adjacency
+        ArenaVector<Quadric> quadrics(vertexCount, Quadric(), alloc);
+        ArenaVector<ArenaVector<uint32_t>> vertexTriangles(vertexCount, ArenaVector<uint32_t>(alloc), alloc);
+
+        for (size_t t = 0; t < triangleCount; t++) {
+
+            glm::vec3 p0 = positions[triangles[t * 3]], p1 = positions[triangles[t * 3 + 1]], p2 = positions[triangles[t * 3 + 2]];
+            glm::vec3 normal = triangleNormal(p0, p1, p2);
+            float length = glm::length(normal);
+
+            for (int k = 0; k < 3; k++) {
+                if (length > 0.0f) {
+                    quadrics[triangles[t * 3 + k]].addPlane(normal / length, -glm::dot(normal / length, p0));
+                }
+                vertexTriangles[triangles[t * 3 + k]].push_back((uint32_t)t);
+            }
+        }
+
+        ArenaVector<uint8_t> triangleDead(triangleCount, 0, alloc);
+        ArenaVector<uint8_t> vertexRemoved(vertexCount, 0, alloc);
+        ArenaVector<uint32_t> versions(vertexCount, 0, alloc);
+
+        //about one queued collapse per vertex plus the re-queued neighbours of each merge
+        ArenaVector<Collapse> queueStorage(alloc);
+        queueStorage.reserve(vertexCount * 2);
+        std::priority_queue<Collapse, ArenaVector<Collapse>, std::greater<Collapse>> queue(std::greater<Collapse>(), std::move(queueStorage));
+
+        ArenaVector<uint32_t> neighbours(alloc);
+        ArenaVector<uint32_t> changed(alloc);
+
+        //also prunes the collapsed triangles from the vertex's list
+        auto gatherNeighbours = [&](uint32_t vertex) {
+            ArenaVector<uint32_t>& around = vertexTriangles[vertex];
+            around.erase(std::remove_if(around.begin(), around.end(), [&](uint32_t t) { return triangleDead[t] != 0; }), around.end());
+
+            neighbours.clear();
+            for (uint32_t t : around) {
+                for (int k = 0; k < 3; k++) {
+                    uint32_t other = triangles[t * 3 + k];
+                    if (other != vertex && std::find(neighbours.begin(), neighbours.end(), other) == neighbours.end()) {
+                        neighbours.push_back(other);
+                    }
+                }
+            }
+        };
+
+        //queues the cheapest collapse of from onto one of its neighbours, one entry per vertex
+        auto updateVertex = [&](uint32_t from) {
+            versions[from]++;
+            if (locked[from] || vertexRemoved[from]) {
+                return;
+            }
+
+            gatherNeighbours(from);
+
+            Collapse best = { -1.0, from, 0, versions[from] };
+            for (uint32_t to : neighbours) {
+
+                Quadric combined = quadrics[from];
+                combined.add(quadrics[to]);
+                double cost = std::max(0.0, combined.evaluate(positions[to]));
+
+                if (best.cost < 0.0 || cost < best.cost) {
+                    best.cost = cost;
+                    best.to = to;
+                }
+            }
+
+            if (best.cost >= 0.0) {
+                queue.push(best);
+            }
+        };
+
+        auto snapshot = [&](size_t liveTriangles, double maxError) {
+            LodIndices lod;
+            lod.indices.reserve(liveTriangles * 3);
+            for (size_t t = 0; t < triangleCount; t++) {
+                if (triangleDead[t]) continue;
+                for (int k = 0; k < 3; k++) {
+                    lod.indices.push_back(representative[triangles[t * 3 + k]]);
+                }
+            }
+            //quadric error is a sum of squared plane distances, report it as a distance
+            lod.error = (float)std::sqrt(maxError);
+            lods.push_back(lod);
+        };
+
+        for (uint32_t v = 0; v < vertexCount; v++) {
+            updateVertex(v);
+        }
+
+        size_t liveTriangles = triangleCount;
+        size_t lastLevelTriangles = triangleCount;
+        double maxError = 0.0;
+
+        while ((int)lods.size() < levels && !queue.empty()) {
+
+            Collapse collapse = queue.top();
+            queue.pop();
+
+            uint32_t from = collapse.from, to = collapse.to;
+            if (vertexRemoved[from] || vertexRemoved[to] || collapse.version != versions[from]) {
+                continue;
+            }
+
+            //reject collapses that flip or flatten a surviving triangle; the vertex is retried once its neighbourhood changes
+            bool valid = true;
+            for (uint32_t t : vertexTriangles[from]) {
+
+                if (triangleDead[t]) continue;
+
+                uint32_t* tri = &triangles[t * 3];
+                if (tri[0] == to || tri[1] == to || tri[2] == to) {
+                    continue;
+                }
+
+                glm::vec3 corners[3] = { positions[tri[0]], positions[tri[1]], positions[tri[2]] };
+                glm::vec3 before = triangleNormal(corners[0], corners[1], corners[2]);
+                for (int k = 0; k < 3; k++) {
+                    if (tri[k] == from) corners[k] = positions[to];
+                }
+                glm::vec3 after = triangleNormal(corners[0], corners[1], corners[2]);
+
+                if (glm::dot(before, after) <= 0.0f || glm::length(after) <= 1e-12f) {
+                    valid = false;
+                    break;
+                }
+            }
+
+            if (!valid) {
+                continue;
+            }
+
+            vertexRemoved[from] = 1;
+            quadrics[to].add(quadrics[from]);
+            maxError = std::max(maxError, collapse.cost);
+
+            for (uint32_t t : vertexTriangles[from]) {
+
+                if (triangleDead[t]) continue;
+
+                uint32_t* tri = &triangles[t * 3];
+                if (tri[0] == to || tri[1] == to || tri[2] == to) {
+                    triangleDead[t] = 1;
+                    liveTriangles--;
+                    continue;
+                }
+
+                for (int k = 0; k < 3; k++) {
+                    if (tri[k] == from) tri[k] = to;
+                }
+                vertexTriangles[to].push_back(t);
+            }
+            vertexTriangles[from].clear();
+
+            //the merged vertex and everything next to it see a new quadric
+            updateVertex(to);
+            gatherNeighbours(to);
+            changed.assign(neighbours.begin(), neighbours.end());
+            for (uint32_t other : changed) {
+                updateVertex(other);
+            }
+
+            if (liveTriangles <= lastLevelTriangles / 2) {
+                snapshot(liveTriangles, maxError);
+                lastLevelTriangles = liveTriangles;
+            }
+        }
+
+        //ran out of collapses: keep what was reached if it is still a worthwhile reduction
+        if ((int)lods.size() < levels && liveTriangles * 5 < lastLevelTriangles * 4) {
+            snapshot(liveTriangles, maxError);
+        }
+
+        return lods;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef MeshSimplifier_hpp
+#define MeshSimplifier_hpp
+
+#include "Mesh.hpp"
+#include "LinearArena.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Quadric error metric simplification (Garland & Heckbert) by half-edge collapses.
+    // A vertex is only ever collapsed onto one of its neighbours, so every level indexes the
+    // original vertex buffer. Mesh borders and attribute seams (same position, different
+    // normal/uv) are locked, which keeps the silhouette of open meshes and the texture layout.
+    class MeshSimplifier {
+
+    public:
+        //returns up to levels simplified index buffers, each with about half the triangles of the previous one;
+        //the working data is allocated from arena, which the caller resets afterwards
+        static std::vector<LodIndices> buildLods(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, int levels, LinearArena& arena);
+    };
+}
+
+#endif /* MeshSimplifier_hpp */
@@ -0,0 +1,269 @@
+#include "Meshlets.hpp"
+#include "CpuProfiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace gps {
+
+    namespace {
+
+        struct PositionHash {
+
+            size_t operator()(const glm::vec3& p) const {
+
+                uint32_t bits[3];
+                std::memcpy(bits, &p, sizeof(bits));
+                return bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u;
+            }
+        };
+
+        struct PositionEqual {
+
+            bool operator()(const glm::vec3& a, const glm::vec3& b) const {
+                return std::memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+            }
+        };
+
+        // a cone that does not fit in a hemisphere can never be back facing as a whole
+        constexpr float NEVER_CULL = 2.0f;
+    }
+
+    void DrawRanges::clear() {
+
+        counts.clear();
+        offsets.clear();
+    }
+
+    void DrawRanges::add(GLuint firstIndex, GLsizei indexCount) {
+
+        size_t offset = firstIndex * sizeof(GLuint);
+        if (!counts.empty() && (size_t)offsets.back() + counts.back() * sizeof(GLuint) == offset) {
+            counts.back() += indexCount;
+            return;
+        }
+
+        counts.push_back(indexCount);
+        offsets.push_back((const GLvoid*)offset);
+    }
+
+    void Meshlets::build(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+        std::vector<Meshlet>& meshlets, BoundingSpheres& spheres, LinearArena& arena) {
+        PROFILE_ZONE("Meshlets::build");
+
+        meshlets.clear();
+        spheres.clear();
+
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0) {
+            return;
+        }
+
+        //the OBJ reader emits one vertex per face corner, connectivity comes from shared positions
+        ArenaAllocator<char> alloc(arena);
+
+        std::unordered_map<glm::vec3, uint32_t, PositionHash, PositionEqual, ArenaAllocator<std::pair<const glm::vec3, uint32_t>>>
+            positionIds(indices.size(), PositionHash(), PositionEqual(), alloc);
+        ArenaVector<uint32_t> cornerIds(triangleCount * 3, 0, alloc);
+
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            auto inserted = positionIds.insert(std::make_pair(vertices[indices[i]].Position, (uint32_t)positionIds.size()));
+            cornerIds[i] = inserted.first->second;
+        }
+
+        //position -> triangles, in compressed rows
+        ArenaVector<uint32_t> adjacencyOffsets(positionIds.size() + 1, 0, alloc);
+        for (uint32_t id : cornerIds) {
+            adjacencyOffsets[id + 1]++;
+        }
+        for (size_t i = 1; i < adjacencyOffsets.size(); i++) {
+            adjacencyOffsets[i] += adjacencyOffsets[i - 1];
+        }
+
+        ArenaVector<uint32_t> adjacency(cornerIds.size(), 0, alloc);
+        ArenaVector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1, alloc);
+        for (size_t i = 0; i < cornerIds.size(); i++) {
+            adjacency[fill[cornerIds[i]]++] = (uint32_t)(i / 3);
+        }
+
+        ArenaVector<glm::vec3> normals(triangleCount, glm::vec3(0.0f), alloc);
+        for (size_t t = 0; t < triangleCount; t++) {
+
+            glm::vec3 p0 = vertices[indices[t * 3]].Position;
+            glm::vec3 normal = glm::cross(vertices[indices[t * 3 + 1]].Position - p0, vertices[indices[t * 3 + 2]].Position - p0);
+            float length = glm::length(normal);
+            normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        }
+
+        ArenaVector<uint8_t> assigned(triangleCount, 0, alloc);
+        std::vector<GLuint> reordered;
+        reordered.reserve(indices.size());
+
+        ArenaVector<uint32_t> meshletVertices(alloc);
+        //marks the positions already in the current meshlet
+        ArenaVector<uint8_t> inMeshlet(positionIds.size(), 0, alloc);
+        ArenaVector<uint32_t> meshletTriangles(alloc);
+        ArenaVector<uint32_t> candidates(alloc);
+        meshletVertices.reserve(MAX_VERTICES);
+        meshletTriangles.reserve(MAX_TRIANGLES);
+        candidates.reserve(MAX_TRIANGLES * 16);
+
+        for (size_t seed = 0; seed < triangleCount; seed++) {
+
+            if (assigned[seed]) continue;
+
+            for (uint32_t id : meshletVertices) {
+                inMeshlet[id] = 0;
+            }
+            meshletVertices.clear();
+            meshletTriangles.clear();
+            candidates.clear();
+            glm::vec3 normalSum(0.0f);
+
+            uint32_t next = (uint32_t)seed;
+
+            //greedy growth: the neighbour adding the fewest new vertices, preferring similar facing
+            while (true) {
+
+                assigned[next] = 1;
+                meshletTriangles.push_back(next);
+                normalSum += normals[next];
+
+                for (int k = 0; k < 3; k++) {
+
+                    uint32_t id = cornerIds[next * 3 + k];
+                    if (!inMeshlet[id]) {
+                        inMeshlet[id] = 1;
+                        meshletVertices.push_back(id);
+                    }
+
+                    for (uint32_t a = adjacencyOffsets[id]; a < adjacencyOffsets[id + 1]; a++) {
+                        if (!assigned[adjacency[a]]) {
+                            candidates.push_back(adjacency[a]);
+                        }
+                    }
+                }
+
+                if ((int)meshletTriangles.size() >= MAX_TRIANGLES) {
+                    break;
+                }
+
+                glm::vec3 averageNormal = glm::length(normalSum) > 0.0f ? glm::normalize(normalSum) : glm::vec3(0.0f);
+                float bestScore = 0.0f;
+                int best = -1;
+                size_t kept = 0;
+
+                for (size_t c = 0; c < candidates.size(); c++) {
+
+                    uint32_t t = candidates[c];
+                    if (assigned[t]) continue;
+                    candidates[kept++] = t;
+
+                    int newVertices = 3 - inMeshlet[cornerIds[t * 3]] - inMeshlet[cornerIds[t * 3 + 1]] - inMeshlet[cornerIds[t * 3 + 2]];
+
+                    if ((int)meshletVertices.size() + newVertices > MAX_VERTICES) continue;
+
+                    float score = newVertices + 2.0f * (1.0f - glm::dot(normals[t], averageNormal));
+                    if (best < 0 || score < bestScore) {
+                        bestScore = score;
+                        best = (int)t;
+                    }
+                }
+                candidates.resize(kept);
+
+                if (best < 0) {
+                    break;
+                }
+                next = (uint32_t)best;
+            }
+
+            Meshlet meshlet;
+            meshlet.firstIndex = (GLuint)reordered.size();
+            meshlet.indexCount = (GLsizei)meshletTriangles.size() * 3;
+
+            glm::vec3 boxMin(1e30f), boxMax(-1e30f);
+            for (uint32_t t : meshletTriangles) {
+                for (int k = 0; k < 3; k++) {
+                    reordered.push_back(indices[t * 3 + k]);
+                    boxMin = glm::min(boxMin, vertices[indices[t * 3 + k]].Position);
+                    boxMax = glm::max(boxMax, vertices[indices[t * 3 + k]].Position);
+                }
+            }
+
+            glm::vec3 center = (boxMin + boxMax) * 0.5f;
+            float radius = 0.0f;
+            for (uint32_t t : meshletTriangles) {
+                for (int k = 0; k < 3; k++) {
+                    radius = std::max(radius, glm::length(vertices[indices[t * 3 + k]].Position - center));
+                }
+            }
+
+            //cone around the average facing, cutoff = sin of its half angle
+            meshlet.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+            meshlet.coneCutoff = NEVER_CULL;
+
+            if (glm::length(normalSum) > 0.0f) {
+
+                glm::vec3 axis = glm::normalize(normalSum);
+                float minDot = 1.0f;
+                for (uint32_t t : meshletTriangles) {
+                    if (glm::length(normals[t]) > 0.0f) {
+                        minDot = std::min(minDot, glm::dot(axis, normals[t]));
+                    }
+                }
+
+                if (minDot > 0.0f) {
+                    meshlet.coneAxis = axis;
+                    meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+                }
+            }
+
+            meshlets.push_back(meshlet);
+            spheres.add(center, radius);
+        }
+
+        indices.swap(reordered);
+    }
+
+    int Meshlets::cull(const std::vector<Meshlet>& meshlets, const BoundingSpheres& spheres, const glm::mat4& clipMatrix,
+        std::vector<uint8_t>& visible, DrawRanges& ranges) {
+
+        ranges.clear();
+
+        Frustum frustum;
+        frustum.extract(clipMatrix);
+        frustum.intersectSpheres(spheres, visible);
+
+        //the viewpoint is what clipMatrix sends to x = y = w = 0: a point for a perspective projection,
+        //a direction (pointing into the scene) for an orthographic one
+        glm::vec4 viewPoint = glm::inverse(clipMatrix) * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+        bool orthographic = std::fabs(viewPoint.w) <= 1e-6f * glm::length(glm::vec3(viewPoint));
+        glm::vec3 eye = orthographic ? glm::normalize(glm::vec3(viewPoint)) : glm::vec3(viewPoint) / viewPoint.w;
+
+        int survivors = 0;
+
+        for (size_t i = 0; i < meshlets.size(); i++) {
+
+            if (!visible[i]) continue;
+
+            const Meshlet& meshlet = meshlets[i];
+            bool backFacing;
+
+            if (orthographic) {
+                backFacing = glm::dot(eye, meshlet.coneAxis) >= meshlet.coneCutoff;
+            } else {
+                glm::vec3 toCenter = glm::vec3(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]) - eye;
+                backFacing = glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + spheres.radius[i];
+            }
+
+            if (backFacing) continue;
+
+            ranges.add(meshlet.firstIndex, meshlet.indexCount);
+            survivors++;
+        }
+
+        return survivors;
+    }
+}
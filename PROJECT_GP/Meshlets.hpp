@@ -0,0 +1,34 @@
+#ifndef Meshlets_hpp
+#define Meshlets_hpp
+
+#include "Mesh.hpp"
+#include "Frustum.hpp"
+#include "LinearArena.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Splits meshes into small clusters of nearby, similarly facing triangles so the big meshes
+    // of the level can be culled piece by piece. Each meshlet keeps a bounding sphere for the
+    // frustum test and a normal cone that tells when all of its triangles face away from a viewpoint.
+    class Meshlets {
+
+    public:
+        static constexpr int MAX_VERTICES = 64;
+        static constexpr int MAX_TRIANGLES = 124;
+
+        //reorders indices so the triangles of each meshlet are contiguous, spheres gets one entry per meshlet;
+        //the working data is allocated from arena
+        static void build(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+            std::vector<Meshlet>& meshlets, BoundingSpheres& spheres, LinearArena& arena);
+
+        //frustum and cone test from the viewpoint of clipMatrix (projection * view * model, perspective or ortho);
+        //ranges gets the surviving meshlets merged into as few index ranges as possible, returns how many survived
+        static int cull(const std::vector<Meshlet>& meshlets, const BoundingSpheres& spheres, const glm::mat4& clipMatrix,
+            std::vector<uint8_t>& visible, DrawRanges& ranges);
+    };
+}
+
+#endif /* Meshlets_hpp */
@@ -1,4 +1,7 @@
 #include "Model3D.hpp"
+#include "CpuProfiler.hpp"
+
+#include <utility>
 
 namespace gps {
 
@@ -13,15 +16,232 @@ namespace gps {
 		ReadOBJ(fileName, basePath);
 	}
 
+	// Switches a permuted shader to the variant matching the mesh's textures (the frame's features stay as
+	// selected by the caller); returns true if the program changed
+	static bool SelectMeshVariant(gps::Shader& shaderProgram, uint32_t frameKey, const gps::Mesh& mesh) {
+
+		uint32_t specularMask = shaderProgram.getFeatureMask("HAS_SPECULAR_MAP");
+		if (specularMask == 0)
+			return false;
+
+		uint32_t key = mesh.HasTexture("specularTexture") ? (frameKey | specularMask) : (frameKey & ~specularMask);
+		if (key == shaderProgram.getVariantKey())
+			return false;
+
+		shaderProgram.selectVariant(key);
+		shaderProgram.useShaderProgram();
+		return true;
+	}
+
 	// Draw each mesh from the model
 	void Model3D::Draw(gps::Shader shaderProgram) {
 
-		for (int i = 0; i < meshes.size(); i++)
+		// full detail, for the lod tint debug view
+		GLint lodLocation = shaderProgram.getUniformLocation("lodLevel");
+		shaderProgram.useShaderProgram();
+		glUniform1i(lodLocation, 0);
+
+		uint32_t frameKey = shaderProgram.getVariantKey();
+
+		for (int i = 0; i < meshes.size(); i++) {
+			if (SelectMeshVariant(shaderProgram, frameKey, meshes[i]))
+				glUniform1i(shaderProgram.getUniformLocation("lodLevel"), 0);
 			meshes[i].Draw(shaderProgram);
+		}
+	}
+
+	// Draw each mesh without its textures
+	void Model3D::DrawDepth(gps::Shader shaderProgram) {
+
+		for (int i = 0; i < meshes.size(); i++)
+			meshes[i].DrawDepth(shaderProgram);
+	}
+
+	// Draw the meshes that survived culling
+	void Model3D::Draw(gps::Shader shaderProgram, const std::vector<uint8_t>& meshVisible, const std::vector<uint8_t>& meshLods,
+		const std::vector<gps::DrawRanges>& meshletRanges) {
+
+		GLint lodLocation = shaderProgram.getUniformLocation("lodLevel");
+		shaderProgram.useShaderProgram();
+		uint32_t frameKey = shaderProgram.getVariantKey();
+
+		for (int i = 0; i < meshes.size(); i++)
+			if (meshVisible[i]) {
+				if (SelectMeshVariant(shaderProgram, frameKey, meshes[i]))
+					lodLocation = shaderProgram.getUniformLocation("lodLevel");
+				glUniform1i(lodLocation, meshLods[i]);
+				if (meshLods[i] == 0 && !meshletRanges.empty())
+					meshes[i].Draw(shaderProgram, meshletRanges[i]);
+				else
+					meshes[i].Draw(shaderProgram, meshLods[i]);
+			}
+	}
+
+	void Model3D::DrawDepth(gps::Shader shaderProgram, const std::vector<uint8_t>& meshVisible, const std::vector<uint8_t>& meshLods,
+		const std::vector<gps::DrawRanges>& meshletRanges) {
+
+		for (int i = 0; i < meshes.size(); i++)
+			if (meshVisible[i]) {
+				if (meshLods[i] == 0 && !meshletRanges.empty())
+					meshes[i].DrawDepth(shaderProgram, meshletRanges[i]);
+				else
+					meshes[i].DrawDepth(shaderProgram, meshLods[i]);
+			}
+	}
+
+	void Model3D::DrawInstanced(gps::Shader shaderProgram, const gps::InstanceBuffer& instances, const std::vector<uint8_t>& meshLods) {
+
+		GLint lodLocation = shaderProgram.getUniformLocation("lodLevel");
+		GLint instancedLocation = shaderProgram.getUniformLocation("instanced");
+		shaderProgram.useShaderProgram();
+		glUniform1i(instancedLocation, 1);
+		uint32_t frameKey = shaderProgram.getVariantKey();
+
+		for (int i = 0; i < meshes.size(); i++) {
+			GLuint previousProgram = shaderProgram.shaderProgram;
+			if (SelectMeshVariant(shaderProgram, frameKey, meshes[i])) {
+				// "instanced" is per program, so the variant left behind is reset now
+				glProgramUniform1i(previousProgram, instancedLocation, 0);
+				lodLocation = shaderProgram.getUniformLocation("lodLevel");
+				instancedLocation = shaderProgram.getUniformLocation("instanced");
+				glUniform1i(instancedLocation, 1);
+			}
+			glUniform1i(lodLocation, meshLods[i]);
+			meshes[i].DrawInstanced(shaderProgram, meshLods[i], instances);
+		}
+
+		glUniform1i(instancedLocation, 0);
+	}
+
+	void Model3D::DrawDepthInstanced(gps::Shader shaderProgram, const gps::InstanceBuffer& instances, const std::vector<uint8_t>& meshLods) {
+
+		GLint instancedLocation = shaderProgram.getUniformLocation("instanced");
+		shaderProgram.useShaderProgram();
+		glUniform1i(instancedLocation, 1);
+
+		for (int i = 0; i < meshes.size(); i++)
+			meshes[i].DrawDepthInstanced(shaderProgram, meshLods[i], instances);
+
+		glUniform1i(instancedLocation, 0);
+	}
+
+	// Coarser levels are only drawn when the mesh is small on screen, so only the full detail is split further
+	int Model3D::CullMeshlets(const glm::mat4& clipMatrix, const std::vector<uint8_t>& meshVisible, const std::vector<uint8_t>& meshLods,
+		std::vector<gps::DrawRanges>& meshletRanges, int& tested) {
+
+		meshletRanges.resize(meshes.size());
+		tested = 0;
+		int culled = 0;
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			meshletRanges[i].clear();
+			if (!meshVisible[i] || meshLods[i] != 0)
+				continue;
+
+			int survivors = gps::Meshlets::cull(meshes[i].meshlets, meshes[i].meshletSpheres, clipMatrix, meshletVisible, meshletRanges[i]);
+			tested += (int)meshes[i].meshlets.size();
+			culled += (int)meshes[i].meshlets.size() - survivors;
+		}
+
+		return culled;
+	}
+
+	// Projects each level's object space error through the clip transform at the nearest point of the mesh sphere
+	void Model3D::SelectLods(const glm::mat4& clipMatrix, float viewportHeight, float maxPixelError, std::vector<uint8_t>& meshLods) const {
+
+		// clip y and w rows: ndc y changes by |rowY.xyz| / w per object unit
+		glm::vec4 rowY(clipMatrix[0][1], clipMatrix[1][1], clipMatrix[2][1], clipMatrix[3][1]);
+		glm::vec4 rowW(clipMatrix[0][3], clipMatrix[1][3], clipMatrix[2][3], clipMatrix[3][3]);
+
+		float unitsToNdc = glm::length(glm::vec3(rowY));
+		float wScale = glm::length(glm::vec3(rowW));
+
+		meshLods.assign(meshes.size(), 0);
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+
+			const gps::Bounds& bounds = meshes[i].bounds;
+			float w = glm::dot(glm::vec3(rowW), bounds.center) + rowW.w - bounds.radius * wScale;
+
+			// the camera is inside or very close to the mesh, keep it at full detail
+			if (w <= 1e-3f)
+				continue;
+
+			float pixelsPerUnit = unitsToNdc / w * viewportHeight * 0.5f;
+
+			for (int lod = (int)meshes[i].lods.size() - 1; lod > 0; lod--)
+				if (meshes[i].lods[lod].error * pixelsPerUnit <= maxPixelError) {
+					meshLods[i] = (uint8_t)lod;
+					break;
+				}
+		}
+	}
+
+	int Model3D::GetMeshCount() const {
+
+		return (int)meshes.size();
+	}
+
+	size_t Model3D::GetCpuBytes() const {
+
+		size_t bytes = meshes.capacity() * sizeof(gps::Mesh);
+		for (size_t i = 0; i < meshes.size(); i++)
+			bytes += meshes[i].GetCpuBytes();
+
+		return bytes;
+	}
+
+	size_t Model3D::GetGpuBytes() const {
+
+		size_t bytes = 0;
+		for (size_t i = 0; i < meshes.size(); i++)
+			bytes += meshes[i].GetGpuBytes();
+
+		return bytes;
+	}
+
+	const gps::BoundingSpheres& Model3D::GetMeshSpheres() const {
+
+		return meshSpheres;
+	}
+
+	const gps::Bounds& Model3D::GetMeshBounds(int index) const {
+
+		return meshes[index].bounds;
+	}
+
+	// Box around the mesh boxes; the sphere encloses the mesh spheres
+	gps::Bounds Model3D::GetBounds() const {
+
+		gps::Bounds bounds;
+		bounds.min = glm::vec3(0.0f);
+		bounds.max = glm::vec3(0.0f);
+
+		if (!meshes.empty()) {
+
+			bounds.min = meshes[0].bounds.min;
+			bounds.max = meshes[0].bounds.max;
+		}
+
+		for (size_t i = 1; i < meshes.size(); i++) {
+
+			bounds.min = glm::min(bounds.min, meshes[i].bounds.min);
+			bounds.max = glm::max(bounds.max, meshes[i].bounds.max);
+		}
+
+		bounds.center = (bounds.min + bounds.max) * 0.5f;
+		bounds.radius = 0.0f;
+
+		for (size_t i = 0; i < meshes.size(); i++)
+			bounds.radius = glm::max(bounds.radius, glm::length(meshes[i].bounds.center - bounds.center) + meshes[i].bounds.radius);
+
+		return bounds;
 	}
 
 	// Does the parsing of the .obj file and fills in the data structure
 	void Model3D::ReadOBJ(std::string fileName, std::string basePath) {
+		PROFILE_ZONE("Model3D::ReadOBJ");
 
         std::cout << "Loading : " << fileName << std::endl;
 		tinyobj::attrib_t attrib;
@@ -46,6 +266,11 @@ namespace gps {
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
 		std::cout << "# of materials : " << materials.size() << std::endl;
 
+		meshes.reserve(meshes.size() + shapes.size());
+
+		// Scratch memory of the meshlet and lod builders, reset after every shape so the blocks are reused
+		gps::LinearArena arena;
+
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
 
@@ -53,6 +278,10 @@ namespace gps {
 			std::vector<GLuint> indices;
 			std::vector<gps::Texture> textures;
 
+			// Every face corner becomes one vertex and one index, so both sizes are known up front
+			vertices.reserve(shapes[s].mesh.indices.size());
+			indices.reserve(shapes[s].mesh.indices.size());
+
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
 			for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
@@ -146,12 +375,103 @@ namespace gps {
 				}
 			}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+			// Meshlets reorder the triangles, so they are built before the levels of detail
+			std::vector<gps::Meshlet> meshlets;
+			gps::BoundingSpheres meshletSpheres;
+			gps::Meshlets::build(vertices, indices, meshlets, meshletSpheres, arena);
+
+			std::vector<gps::LodIndices> lodIndices;
+			if (lodLevels > 1)
+				lodIndices = gps::MeshSimplifier::buildLods(vertices, indices, lodLevels - 1, arena);
+
+			arena.reset();
+
+			gps::Bounds bounds = ComputeBounds(vertices);
+
+			// the shape's arrays are not needed here anymore, hand them to the mesh instead of copying
+			gps::Mesh mesh(std::move(vertices), std::move(indices), std::move(textures), lodIndices, packVertices);
+			mesh.bounds = bounds;
+			mesh.meshlets = std::move(meshlets);
+			mesh.meshletSpheres = std::move(meshletSpheres);
+			meshSpheres.add(mesh.bounds.center, mesh.bounds.radius);
+
+			if (releaseCpuData)
+				mesh.ReleaseCpuData();
+
+			meshes.push_back(std::move(mesh));
 		}
+
+		// Triangles per level of detail, summed over the meshes
+		std::vector<size_t> lodTriangles;
+		for (size_t i = 0; i < meshes.size(); i++)
+			for (size_t lod = 0; lod < meshes[i].lods.size(); lod++) {
+				if (lodTriangles.size() <= lod)
+					lodTriangles.push_back(0);
+				lodTriangles[lod] += meshes[i].lods[lod].indexCount / 3;
+			}
+
+		std::cout << "# load arena : peak " << arena.getPeakBytes() / 1024 << " KB in " << arena.getBlockCount() << " blocks" << std::endl;
+		std::cout << "# mesh memory : " << GetCpuBytes() / 1024 << " KB in RAM, " << GetGpuBytes() / 1024 << " KB in GL buffers" << std::endl;
+
+		std::cout << "# of triangles per lod :";
+		for (size_t lod = 0; lod < lodTriangles.size(); lod++)
+			std::cout << " " << lodTriangles[lod];
+		std::cout << std::endl;
+
+		if (packVertices) {
+
+			// Worst case over the meshes, so the packed format can be checked against the model's size
+			gps::QuantizationError worst;
+			glm::vec3 modelMin(1e30f), modelMax(-1e30f);
+			for (size_t i = 0; i < meshes.size(); i++) {
+
+				worst.position = glm::max(worst.position, meshes[i].quantizationError.position);
+				worst.normalDegrees = glm::max(worst.normalDegrees, meshes[i].quantizationError.normalDegrees);
+				worst.texCoords = glm::max(worst.texCoords, meshes[i].quantizationError.texCoords);
+				modelMin = glm::min(modelMin, meshes[i].bounds.min);
+				modelMax = glm::max(modelMax, meshes[i].bounds.max);
+			}
+
+			float extent = glm::length(modelMax - modelMin);
+			std::cout << "# packed vertex error : position " << worst.position
+				<< " (" << (extent > 0.0f ? 100.0f * worst.position / extent : 0.0f) << "% of the model)"
+				<< ", normal " << worst.normalDegrees << " deg"
+				<< ", uv " << worst.texCoords << std::endl;
+		}
+	}
+
+	// Axis aligned box and enclosing sphere of the vertices
+	gps::Bounds Model3D::ComputeBounds(const std::vector<gps::Vertex>& vertices) {
+
+		gps::Bounds bounds;
+		bounds.min = glm::vec3(0.0f);
+		bounds.max = glm::vec3(0.0f);
+
+		if (!vertices.empty()) {
+
+			bounds.min = vertices[0].Position;
+			bounds.max = vertices[0].Position;
+		}
+
+		for (size_t i = 1; i < vertices.size(); i++) {
+
+			bounds.min = glm::min(bounds.min, vertices[i].Position);
+			bounds.max = glm::max(bounds.max, vertices[i].Position);
+		}
+
+		// sphere around the box center, radius from the actual vertices (tighter than the half diagonal)
+		bounds.center = (bounds.min + bounds.max) * 0.5f;
+		bounds.radius = 0.0f;
+
+		for (size_t i = 0; i < vertices.size(); i++)
+			bounds.radius = glm::max(bounds.radius, glm::length(vertices[i].Position - bounds.center));
+
+		return bounds;
 	}
 
 	// Retrieves a texture associated with the object - by its name and type
 	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
+		PROFILE_ZONE("Model3D::LoadTexture");
 
 			for (int i = 0; i < loadedTextures.size(); i++) {
 
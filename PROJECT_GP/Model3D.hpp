@@ -2,6 +2,10 @@
 #define Model3D_hpp
 
 #include "Mesh.hpp"
+#include "Frustum.hpp"
+#include "MeshSimplifier.hpp"
+#include "Meshlets.hpp"
+#include "LinearArena.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
@@ -15,6 +19,13 @@ namespace gps {
     class Model3D {
 
     public:
+        // levels of detail built per mesh when loading, including the full mesh (1 disables simplification)
+        int lodLevels = 4;
+        // upload gps::PackedVertex (16 bytes) instead of gps::Vertex (32 bytes), for shaders built with PACKED_VERTICES
+        bool packVertices = false;
+        // free each mesh's vertices and indices once they are uploaded (bounds, counts and culling data stay)
+        bool releaseCpuData = false;
+
         ~Model3D();
 
 		void LoadModel(std::string fileName);
@@ -23,15 +34,62 @@ namespace gps {
 
 		void Draw(gps::Shader shaderProgram);
 
+		// Draw without binding textures, for depth-only passes
+		void DrawDepth(gps::Shader shaderProgram);
+
+		// Draw only the meshes flagged in meshVisible (one entry per mesh, see GetMeshSpheres),
+		// each at the level of detail picked by SelectLods; meshes at full detail are limited to
+		// their meshletRanges from CullMeshlets (pass an empty vector to draw them whole)
+		void Draw(gps::Shader shaderProgram, const std::vector<uint8_t>& meshVisible, const std::vector<uint8_t>& meshLods,
+			const std::vector<gps::DrawRanges>& meshletRanges);
+		void DrawDepth(gps::Shader shaderProgram, const std::vector<uint8_t>& meshVisible, const std::vector<uint8_t>& meshLods,
+			const std::vector<gps::DrawRanges>& meshletRanges);
+
+		// One copy of the model per matrix in instances, one draw call per mesh; every mesh is drawn at
+		// the level in meshLods, so pick it for the instance nearest to the viewer. The shaders take the
+		// model matrix from the instance attributes instead of the model uniform (see shaders/instancing.glsl)
+		void DrawInstanced(gps::Shader shaderProgram, const gps::InstanceBuffer& instances, const std::vector<uint8_t>& meshLods);
+		void DrawDepthInstanced(gps::Shader shaderProgram, const gps::InstanceBuffer& instances, const std::vector<uint8_t>& meshLods);
+
+		// Coarsest level per mesh whose error projects to at most maxPixelError pixels
+		// for the given object to clip transform and viewport height
+		void SelectLods(const glm::mat4& clipMatrix, float viewportHeight, float maxPixelError, std::vector<uint8_t>& meshLods) const;
+
+		// Frustum and normal cone culling of the meshlets of the visible full detail meshes,
+		// returns how many meshlets were culled, tested gets how many were looked at
+		int CullMeshlets(const glm::mat4& clipMatrix, const std::vector<uint8_t>& meshVisible, const std::vector<uint8_t>& meshLods,
+			std::vector<gps::DrawRanges>& meshletRanges, int& tested);
+
+		int GetMeshCount() const;
+
+		// Bytes held by the meshes in RAM and in GL buffers (textures not included)
+		size_t GetCpuBytes() const;
+		size_t GetGpuBytes() const;
+
+		// Object space bounding spheres of the meshes, in draw order
+		const gps::BoundingSpheres& GetMeshSpheres() const;
+
+		const gps::Bounds& GetMeshBounds(int index) const;
+
+		// Object space bounds of the whole model
+		gps::Bounds GetBounds() const;
+
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
+		// Mesh bounding spheres, laid out for batched frustum tests
+		gps::BoundingSpheres meshSpheres;
+		// Scratch for the per-meshlet frustum results
+		std::vector<uint8_t> meshletVisible;
 		// Associated textures
         std::vector<gps::Texture> loadedTextures;
 
 		// Does the parsing of the .obj file and fills in the data structure
 		void ReadOBJ(std::string fileName, std::string basePath);
 
+		// Axis aligned box and enclosing sphere of the vertices
+		gps::Bounds ComputeBounds(const std::vector<gps::Vertex>& vertices);
+
 		// Retrieves a texture associated with the object - by its name and type
 		gps::Texture LoadTexture(std::string path, std::string type);
 
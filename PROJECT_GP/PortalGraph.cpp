@@ -0,0 +1,299 @@
+#include "PortalGraph.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace gps {
+
+    static const glm::vec4 FULL_SCREEN_RECT(-1.0f, -1.0f, 1.0f, 1.0f);
+
+    // format, one entry per line, '#' starts a comment:
+    //   cell <name> <min x y z> <max x y z>
+    //   portal <name> <cell> <cell> <4 corners x y z>
+    bool PortalGraph::load(const std::string& fileName) {
+
+        cells.clear();
+        portals.clear();
+
+        std::ifstream file(fileName);
+        if (!file.is_open()) {
+            std::cout << "Failed to open portal file: " << fileName << std::endl;
+            return false;
+        }
+
+        std::string line;
+        int lineNumber = 0;
+
+        while (std::getline(file, line)) {
+
+            lineNumber++;
+            line = line.substr(0, line.find('#'));
+
+            std::istringstream tokens(line);
+            std::string type;
+            if (!(tokens >> type)) {
+                continue;
+            }
+
+            if (type == "cell") {
+
+                Cell cell;
+                tokens >> cell.name >> cell.min.x >> cell.min.y >> cell.min.z >> cell.max.x >> cell.max.y >> cell.max.z;
+                if (tokens.fail()) {
+                    std::cout << fileName << ":" << lineNumber << ": malformed cell" << std::endl;
+                    continue;
+                }
+                cells.push_back(cell);
+
+            } else if (type == "portal") {
+
+                Portal portal;
+                std::string cellNames[2];
+                tokens >> portal.name >> cellNames[0] >> cellNames[1];
+                for (int i = 0; i < 4; i++) {
+                    tokens >> portal.corners[i].x >> portal.corners[i].y >> portal.corners[i].z;
+                }
+
+                portal.cells[0] = findCellByName(cellNames[0]);
+                portal.cells[1] = findCellByName(cellNames[1]);
+
+                if (tokens.fail() || portal.cells[0] < 0 || portal.cells[1] < 0) {
+                    std::cout << fileName << ":" << lineNumber << ": malformed portal or unknown cell" << std::endl;
+                    continue;
+                }
+
+                //a portal lies on the boundary both its cells share, so every corner is inside each box
+                for (int c = 0; c < 2; c++) {
+                    const Cell& cell = cells[portal.cells[c]];
+                    for (int i = 0; i < 4; i++) {
+                        if (!glm::all(glm::greaterThanEqual(portal.corners[i], cell.min)) || !glm::all(glm::lessThanEqual(portal.corners[i], cell.max))) {
+                            std::cout << fileName << ":" << lineNumber << ": portal " << portal.name << " reaches outside cell " << cell.name << std::endl;
+                            break;
+                        }
+                    }
+                }
+
+                int index = (int)portals.size();
+                portals.push_back(portal);
+                cells[portal.cells[0]].portals.push_back(index);
+                cells[portal.cells[1]].portals.push_back(index);
+
+            } else {
+                std::cout << fileName << ":" << lineNumber << ": unknown entry " << type << std::endl;
+            }
+        }
+
+        std::cout << "Portal graph: " << cells.size() << " cells, " << portals.size() << " portals" << std::endl;
+        return true;
+    }
+
+    bool PortalGraph::empty() const {
+        return cells.empty();
+    }
+
+    int PortalGraph::getNumCells() const {
+        return (int)cells.size();
+    }
+
+    int PortalGraph::findCellByName(const std::string& name) const {
+
+        for (size_t i = 0; i < cells.size(); i++) {
+            if (cells[i].name == name) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+    int PortalGraph::findPortal(const std::string& name) const {
+
+        for (size_t i = 0; i < portals.size(); i++) {
+            if (portals[i].name == name) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+    void PortalGraph::setPortalOpen(int portal, bool open) {
+
+        if (portal >= 0 && portal < (int)portals.size()) {
+            portals[portal].open = open;
+        }
+    }
+
+    int PortalGraph::findCell(glm::vec3 center, float radius) const {
+
+        for (size_t i = 0; i < cells.size(); i++) {
+            if (glm::all(glm::greaterThanEqual(center - radius, cells[i].min)) &&
+                glm::all(glm::lessThanEqual(center + radius, cells[i].max))) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+    // screen rectangle covered by the portal, false if it is entirely behind the viewer
+    bool PortalGraph::projectPortal(const Portal& portal, const glm::mat4& viewProjection, glm::vec4& rect) const {
+
+        glm::vec4 clip[4];
+        int behind = 0;
+
+        for (int i = 0; i < 4; i++) {
+            clip[i] = viewProjection * glm::vec4(portal.corners[i], 1.0f);
+            if (clip[i].w <= 1e-4f) {
+                behind++;
+            }
+        }
+
+        if (behind == 4) {
+            return false;
+        }
+
+        if (behind > 0) {
+            //the portal crosses the eye plane (viewer standing in the doorway), keep the whole screen
+            rect = FULL_SCREEN_RECT;
+            return true;
+        }
+
+        rect = glm::vec4(1e30f, 1e30f, -1e30f, -1e30f);
+        for (int i = 0; i < 4; i++) {
+            glm::vec2 ndc = glm::vec2(clip[i]) / clip[i].w;
+            rect.x = std::min(rect.x, ndc.x);
+            rect.y = std::min(rect.y, ndc.y);
+            rect.z = std::max(rect.z, ndc.x);
+            rect.w = std::max(rect.w, ndc.y);
+        }
+
+        return true;
+    }
+
+    void PortalGraph::flood(int cell, const glm::mat4& viewProjection, glm::vec4 rect,
+        std::vector<int>& path, CellVisibility& result) const {
+
+        //a cell reached along several paths is seen through the union of their rectangles
+        if (result.visible[cell]) {
+            glm::vec4& seen = result.rects[cell];
+            seen = glm::vec4(std::min(seen.x, rect.x), std::min(seen.y, rect.y), std::max(seen.z, rect.z), std::max(seen.w, rect.w));
+        } else {
+            result.visible[cell] = 1;
+            result.rects[cell] = rect;
+        }
+
+        if ((int)path.size() >= MAX_PORTAL_DEPTH) {
+            return;
+        }
+
+        path.push_back(cell);
+
+        for (size_t i = 0; i < cells[cell].portals.size(); i++) {
+
+            const Portal& portal = portals[cells[cell].portals[i]];
+            if (!portal.open) {
+                continue;
+            }
+
+            int neighbour = (portal.cells[0] == cell) ? portal.cells[1] : portal.cells[0];
+            if (std::find(path.begin(), path.end(), neighbour) != path.end()) {
+                continue;
+            }
+
+            glm::vec4 portalRect;
+            if (!projectPortal(portal, viewProjection, portalRect)) {
+                continue;
+            }
+
+            glm::vec4 narrowed(std::max(rect.x, portalRect.x), std::max(rect.y, portalRect.y),
+                std::min(rect.z, portalRect.z), std::min(rect.w, portalRect.w));
+
+            if (narrowed.x >= narrowed.z || narrowed.y >= narrowed.w) {
+                continue;
+            }
+
+            flood(neighbour, viewProjection, narrowed, path, result);
+        }
+
+        path.pop_back();
+    }
+
+    void PortalGraph::computeVisibility(glm::vec3 eye, const glm::mat4& viewProjection, CellVisibility& result) const {
+
+        result.visible.assign(cells.size(), 0);
+        result.rects.assign(cells.size(), FULL_SCREEN_RECT);
+
+        int startCell = findCell(eye, 0.0f);
+        result.valid = (startCell >= 0);
+
+        if (!result.valid) {
+            return;
+        }
+
+        std::vector<int> path;
+        flood(startCell, viewProjection, FULL_SCREEN_RECT, path, result);
+    }
+
+    glm::mat4 PortalGraph::narrowToRect(const glm::mat4& viewProjection, glm::vec4 rect) {
+
+        //remap the rectangle to [-1, 1] in ndc, the clip planes of the product then bound the rectangle
+        glm::vec2 scale(2.0f / (rect.z - rect.x), 2.0f / (rect.w - rect.y));
+        glm::vec2 offset(-(rect.z + rect.x) / (rect.z - rect.x), -(rect.w + rect.y) / (rect.w - rect.y));
+
+        glm::mat4 remap(1.0f);
+        remap[0][0] = scale.x;
+        remap[1][1] = scale.y;
+        remap[3][0] = offset.x;
+        remap[3][1] = offset.y;
+
+        return remap * viewProjection;
+    }
+
+    int PortalGraph::cullSpheres(const BoundingSpheres& spheres, const glm::mat4& modelMatrix, const glm::mat4& viewProjection,
+        const CellVisibility& visibility, std::vector<uint8_t>& visible) const {
+
+        Frustum frustum;
+        frustum.extract(viewProjection * modelMatrix);
+        int visibleCount = frustum.intersectSpheres(spheres, visible);
+
+        if (!visibility.valid) {
+            return visibleCount;
+        }
+
+        //largest axis scale, so the world sphere still encloses the mesh
+        float scale = std::sqrt(std::max(glm::dot(glm::vec3(modelMatrix[0]), glm::vec3(modelMatrix[0])),
+            std::max(glm::dot(glm::vec3(modelMatrix[1]), glm::vec3(modelMatrix[1])),
+                glm::dot(glm::vec3(modelMatrix[2]), glm::vec3(modelMatrix[2])))));
+
+        for (size_t i = 0; i < spheres.count; i++) {
+
+            if (!visible[i]) {
+                continue;
+            }
+
+            glm::vec3 center(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]);
+            glm::vec3 worldCenter = glm::vec3(modelMatrix * glm::vec4(center, 1.0f));
+
+            //meshes spanning several cells are only frustum culled
+            int cell = findCell(worldCenter, spheres.radius[i] * scale);
+            if (cell < 0) {
+                continue;
+            }
+
+            bool seen = visibility.visible[cell] != 0;
+            if (seen && visibility.rects[cell] != FULL_SCREEN_RECT) {
+                Frustum cellFrustum;
+                cellFrustum.extract(narrowToRect(viewProjection, visibility.rects[cell]) * modelMatrix);
+                seen = cellFrustum.intersectsSphere(center, spheres.radius[i]);
+            }
+
+            if (!seen) {
+                visible[i] = 0;
+                visibleCount--;
+            }
+        }
+
+        return visibleCount;
+    }
+}
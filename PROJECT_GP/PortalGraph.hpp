@@ -0,0 +1,82 @@
+#ifndef PortalGraph_hpp
+#define PortalGraph_hpp
+
+#include <glm/glm.hpp>
+
+#include "Frustum.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    struct Cell {
+
+        std::string name;
+        glm::vec3 min;
+        glm::vec3 max;
+        //indices into the portal list
+        std::vector<int> portals;
+    };
+
+    struct Portal {
+
+        std::string name;
+        int cells[2];
+        glm::vec3 corners[4];
+        //a closed portal (shut door) blocks visibility
+        bool open = true;
+    };
+
+    // result of a portal flood from one viewpoint
+    struct CellVisibility {
+
+        //false when the viewpoint is outside every cell, culling then falls back to the plain frustum
+        bool valid = false;
+        std::vector<uint8_t> visible;
+        //ndc rectangle (min x, min y, max x, max y) each visible cell is seen through
+        std::vector<glm::vec4> rects;
+    };
+
+    // Cells (axis aligned boxes) connected by portal quads, loaded from a text file.
+    // The view is flooded from the viewpoint's cell through every portal that projects inside
+    // the current screen rectangle, narrowing the rectangle at each step.
+    class PortalGraph {
+
+    public:
+        static constexpr int MAX_PORTAL_DEPTH = 8;
+
+        bool load(const std::string& fileName);
+
+        bool empty() const;
+        int getNumCells() const;
+        int findPortal(const std::string& name) const;
+        void setPortalOpen(int portal, bool open);
+
+        //cell whose box fully contains the sphere, -1 if none does
+        int findCell(glm::vec3 center, float radius) const;
+
+        void computeVisibility(glm::vec3 eye, const glm::mat4& viewProjection, CellVisibility& result) const;
+
+        //visible[i] = 1 if sphere i (object space of modelMatrix) is inside the view frustum and,
+        //for spheres that lie inside one cell, inside the rectangle that cell is seen through
+        //returns the number of visible spheres
+        int cullSpheres(const BoundingSpheres& spheres, const glm::mat4& modelMatrix, const glm::mat4& viewProjection,
+            const CellVisibility& visibility, std::vector<uint8_t>& visible) const;
+
+        //view projection whose frustum is cut down to the ndc rectangle
+        static glm::mat4 narrowToRect(const glm::mat4& viewProjection, glm::vec4 rect);
+
+    private:
+        std::vector<Cell> cells;
+        std::vector<Portal> portals;
+
+        int findCellByName(const std::string& name) const;
+        bool projectPortal(const Portal& portal, const glm::mat4& viewProjection, glm::vec4& rect) const;
+        void flood(int cell, const glm::mat4& viewProjection, glm::vec4 rect,
+            std::vector<int>& path, CellVisibility& result) const;
+    };
+}
+
+#endif /* PortalGraph_hpp */
@@ -0,0 +1,150 @@
+#include "ProgramCache.hpp"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+namespace gps {
+
+    namespace {
+
+        //"GPSB" followed by the key, so a renamed or truncated file is never handed to the driver
+        const uint32_t FILE_MAGIC = 0x42535047;
+
+        struct FileHeader {
+            uint32_t magic;
+            GLenum format;
+            uint64_t key;
+            uint32_t length;
+        };
+
+        bool enabled = false;
+        std::string cacheDirectory;
+        std::string driverIdentity;
+        ProgramCache::Stats stats;
+
+        uint64_t hashBytes(uint64_t hash, const std::string& bytes) {
+
+            //FNV-1a, with a separator so the concatenation of two strings cannot collide with another split
+            for (size_t i = 0; i < bytes.size(); i++) {
+                hash ^= (unsigned char)bytes[i];
+                hash *= 1099511628211ull;
+            }
+            hash ^= 0xff;
+            hash *= 1099511628211ull;
+            return hash;
+        }
+
+        std::string glString(GLenum name) {
+
+            const GLubyte* value = glGetString(name);
+            return value != NULL ? std::string((const char*)value) : std::string();
+        }
+    }
+
+    void ProgramCache::init(const std::string& directory) {
+
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        enabled = formatCount > 0;
+        if (!enabled) {
+            return;
+        }
+
+        cacheDirectory = directory;
+        driverIdentity = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION);
+
+        std::error_code error;
+        std::filesystem::create_directories(cacheDirectory, error);
+        if (error) {
+            printf("Program cache disabled, cannot create %s: %s\n", cacheDirectory.c_str(), error.message().c_str());
+            enabled = false;
+        }
+    }
+
+    bool ProgramCache::isEnabled() {
+        return enabled;
+    }
+
+    uint64_t ProgramCache::computeKey(const std::string& vertexSource, const std::string& fragmentSource) {
+
+        uint64_t hash = 14695981039346656037ull;
+        hash = hashBytes(hash, driverIdentity);
+        hash = hashBytes(hash, vertexSource);
+        hash = hashBytes(hash, fragmentSource);
+        return hash;
+    }
+
+    std::string ProgramCache::getPath(uint64_t key) {
+
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return cacheDirectory + "/" + name;
+    }
+
+    bool ProgramCache::load(GLuint program, const std::string& vertexSource, const std::string& fragmentSource) {
+
+        if (!enabled) {
+            return false;
+        }
+
+        uint64_t key = computeKey(vertexSource, fragmentSource);
+        std::ifstream file(getPath(key), std::ios::binary);
+        if (!file) {
+            return false;
+        }
+
+        FileHeader header;
+        std::vector<char> binary;
+        if (file.read((char*)&header, sizeof(header)) && header.magic == FILE_MAGIC && header.key == key) {
+            binary.resize(header.length);
+            file.read(binary.data(), header.length);
+        }
+
+        if (binary.empty() || !file) {
+            return false;
+        }
+
+        glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+
+        //a driver that changed its mind about the format fails the "link" here, the caller compiles instead
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (linked != GL_TRUE) {
+            stats.rejected++;
+            return false;
+        }
+
+        stats.hits++;
+        return true;
+    }
+
+    void ProgramCache::store(GLuint program, const std::string& vertexSource, const std::string& fragmentSource) {
+
+        if (!enabled) {
+            return;
+        }
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return;
+        }
+
+        std::vector<char> binary(length);
+        FileHeader header;
+        header.magic = FILE_MAGIC;
+        header.key = computeKey(vertexSource, fragmentSource);
+        glGetProgramBinary(program, length, NULL, &header.format, binary.data());
+        header.length = (uint32_t)length;
+
+        std::ofstream file(getPath(header.key), std::ios::binary | std::ios::trunc);
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), binary.size());
+    }
+
+    ProgramCache::Stats& ProgramCache::getStats() {
+        return stats;
+    }
+}
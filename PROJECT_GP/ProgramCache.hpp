@@ -0,0 +1,51 @@
+#ifndef ProgramCache_hpp
+#define ProgramCache_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstdint>
+#include <string>
+
+namespace gps {
+
+    // On-disk cache of linked program binaries (glGetProgramBinary / glProgramBinary), one file per program.
+    // Files are keyed by a hash of the preprocessed sources together with the GL vendor, renderer and
+    // version strings, so a driver update or an edited shader simply misses instead of loading stale code
+    class ProgramCache {
+
+    public:
+        struct Stats {
+            int hits = 0;
+            //programs built from source, cache misses and rejections included
+            int compiled = 0;
+            //binaries found on disk that the driver refused to load
+            int rejected = 0;
+            double loadMs = 0.0;
+            double compileMs = 0.0;
+        };
+
+        //needs a current context; the cache stays off if the driver reports no binary formats
+        static void init(const std::string& directory);
+        static bool isEnabled();
+
+        //links program from the cached binary of these sources, false if there is none or the driver rejects it
+        static bool load(GLuint program, const std::string& vertexSource, const std::string& fragmentSource);
+        //saves the binary of a successfully linked program
+        static void store(GLuint program, const std::string& vertexSource, const std::string& fragmentSource);
+
+        //counted by gps::Shader as programs are loaded
+        static Stats& getStats();
+
+    private:
+        static uint64_t computeKey(const std::string& vertexSource, const std::string& fragmentSource);
+        static std::string getPath(uint64_t key);
+    };
+}
+
+#endif /* ProgramCache_hpp */
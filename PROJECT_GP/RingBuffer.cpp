@@ -0,0 +1,152 @@
+#include "RingBuffer.hpp"
+
+#include <cstring>
+
+namespace gps {
+
+    void RingBuffer::init(GLenum target, GLsizeiptr sectionSize, bool allowPersistent) {
+
+        this->target = target;
+
+        if (target == GL_UNIFORM_BUFFER) {
+            GLint uniformAlignment = 16;
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+            alignment = uniformAlignment;
+        }
+
+        //whole sections, so every section starts aligned
+        this->sectionSize = (sectionSize + alignment - 1) / alignment * alignment;
+        GLsizeiptr totalSize = this->sectionSize * SECTIONS;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+
+#if !defined (__APPLE__)
+        persistent = allowPersistent && GLEW_ARB_buffer_storage != 0;
+        if (persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(target, totalSize, NULL, flags);
+            mapped = (char*)glMapBufferRange(target, 0, totalSize, flags);
+            persistent = (mapped != NULL);
+        }
+#endif
+
+        if (!persistent) {
+            glBufferData(target, totalSize, NULL, GL_STREAM_DRAW);
+        }
+
+        glBindBuffer(target, 0);
+
+        section = 0;
+        head = 0;
+        restart = 0;
+    }
+
+    void RingBuffer::destroy() {
+
+        for (int i = 0; i < SECTIONS; i++) {
+            if (fences[i] != NULL) {
+                glDeleteSync(fences[i]);
+                fences[i] = NULL;
+            }
+        }
+
+        if (mapped != NULL) {
+            glBindBuffer(target, buffer);
+            glUnmapBuffer(target);
+            glBindBuffer(target, 0);
+            mapped = NULL;
+        }
+
+        glDeleteBuffers(1, &buffer);
+    }
+
+    bool RingBuffer::waitFence(GLsync& fence) {
+
+        if (fence == NULL) {
+            return false;
+        }
+
+        //poll first, only flush and block when the GPU is actually behind
+        bool waited = false;
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        while (result == GL_TIMEOUT_EXPIRED) {
+            waited = true;
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        }
+
+        glDeleteSync(fence);
+        fence = NULL;
+        return waited;
+    }
+
+    void RingBuffer::beginFrame() {
+
+        section = (section + 1) % SECTIONS;
+        head = 0;
+        restart = 0;
+
+        if (waitFence(fences[section])) {
+            frameWaits++;
+        }
+    }
+
+    void RingBuffer::endFrame() {
+
+        if (fences[section] != NULL) {
+            glDeleteSync(fences[section]);
+        }
+        fences[section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    GLintptr RingBuffer::write(const void* data, GLsizeiptr size) {
+
+        if (head + size > sectionSize) {
+            //the whole section is queued for this frame: wait for those draws, then start over
+            //behind the ranges that are still bound
+            GLsync full = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            waitFence(full);
+            head = restart;
+            overflows++;
+        }
+
+        GLintptr offset = section * sectionSize + head;
+        head = (head + size + alignment - 1) / alignment * alignment;
+
+        if (persistent) {
+            memcpy(mapped + offset, data, size);
+            return offset;
+        }
+
+        //one call per write; mapping and unmapping every range costs more on drivers without buffer storage
+        glBindBuffer(target, buffer);
+        glBufferSubData(target, offset, size, data);
+        glBindBuffer(target, 0);
+
+        return offset;
+    }
+
+    GLintptr RingBuffer::writeForFrame(const void* data, GLsizeiptr size) {
+
+        GLintptr offset = write(data, size);
+        restart = head;
+        return offset;
+    }
+
+    void RingBuffer::bindRange(GLuint index, GLintptr offset, GLsizeiptr size) const {
+
+        glBindBufferRange(target, index, buffer, offset, size);
+    }
+
+    bool RingBuffer::isPersistent() const {
+        return persistent;
+    }
+
+    int RingBuffer::getFrameWaits() const {
+        return frameWaits;
+    }
+
+    int RingBuffer::getOverflows() const {
+        return overflows;
+    }
+}
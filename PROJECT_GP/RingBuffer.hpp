@@ -0,0 +1,70 @@
+#ifndef RingBuffer_hpp
+#define RingBuffer_hpp
+
+#if defined (__APPLE__)
+    #define GL_SILENCE_DEPRECATION
+    #include <OpenGL/gl3.h>
+#else
+    #define GLEW_STATIC
+    #include <GL/glew.h>
+#endif
+
+#include <cstddef>
+
+namespace gps {
+
+    // Streaming buffer split into SECTIONS per-frame sections: each frame writes into its own section and
+    // binds ranges of it, and a fence keeps the CPU from reusing a section the GPU may still read.
+    // With ARB_buffer_storage the buffer is mapped once, persistently and coherently; otherwise each write
+    // is a glBufferSubData into its range, which the fences make safe just the same
+    class RingBuffer {
+
+    public:
+        static constexpr int SECTIONS = 3;
+
+        //target is GL_UNIFORM_BUFFER or any other bindable target; sectionSize is the budget of one frame
+        //allowPersistent = false takes the glBufferSubData path even where ARB_buffer_storage exists
+        void init(GLenum target, GLsizeiptr sectionSize, bool allowPersistent = true);
+        void destroy();
+
+        //moves to the next section, waiting for the GPU only if it is still using it
+        void beginFrame();
+        //fences everything written since beginFrame()
+        void endFrame();
+
+        //copies data into the current section, returns its offset (aligned for glBindBufferRange)
+        GLintptr write(const void* data, GLsizeiptr size);
+        //same as write(), for data that stays bound the whole frame: a section that runs out of room
+        //starts over after it instead of at its beginning, so it is never overwritten before endFrame()
+        GLintptr writeForFrame(const void* data, GLsizeiptr size);
+        void bindRange(GLuint index, GLintptr offset, GLsizeiptr size) const;
+
+        bool isPersistent() const;
+        //frames that had to wait for their section, and writes that ran out of room in one
+        int getFrameWaits() const;
+        int getOverflows() const;
+
+    private:
+        GLenum target = GL_UNIFORM_BUFFER;
+        GLuint buffer = 0;
+        GLsizeiptr sectionSize = 0;
+        GLintptr alignment = 16;
+
+        bool persistent = false;
+        char* mapped = NULL;
+
+        GLsync fences[SECTIONS] = { NULL, NULL, NULL };
+        int section = 0;
+        GLintptr head = 0;
+        //where an overflowing section starts over, past the data written with writeForFrame()
+        GLintptr restart = 0;
+
+        int frameWaits = 0;
+        int overflows = 0;
+
+        //blocks until the fence is signaled and deletes it, returns true if it was not signaled yet
+        static bool waitFence(GLsync& fence);
+    };
+}
+
+#endif /* RingBuffer_hpp */
@@ -8,9 +8,27 @@
 
 #include "Shader.hpp"
 
+#include <cstring>
+
 namespace gps {
+
+    namespace {
+
+        struct UniformLocation {
+            std::string name;
+            GLint location;
+        };
+
+        //per program, filled as the draws ask
+        std::map<GLuint, std::vector<UniformLocation>> uniformLocations;
+    }
+
     std::string Shader::readShaderFile(std::string fileName) {
 
+        if (this->sources && std::find(this->sources->files.begin(), this->sources->files.end(), fileName) == this->sources->files.end()) {
+            this->sources->files.push_back(fileName);
+        }
+
         std::ifstream shaderFile;
         std::string shaderString;
         
@@ -27,7 +45,62 @@ namespace gps {
         
         //convert stream into GLchar array
         shaderString = shaderStringStream.str();
-        return shaderString;
+        return resolveIncludes(shaderString, fileName);
+    }
+
+    //replaces every #include "file" line with that file, looked up next to the including file
+    std::string Shader::resolveIncludes(std::string source, std::string fileName) {
+
+        std::string directory = fileName.substr(0, fileName.find_last_of("/\\") + 1);
+        std::stringstream input(source);
+        std::stringstream output;
+        std::string line;
+
+        while (std::getline(input, line)) {
+
+            size_t directivePos = line.find("#include");
+            if (directivePos != std::string::npos && directivePos == line.find_first_not_of(" \t")) {
+
+                size_t open = line.find('"', directivePos);
+                size_t close = (open == std::string::npos) ? std::string::npos : line.find('"', open + 1);
+
+                if (close != std::string::npos) {
+                    std::string includeFileName = directory + line.substr(open + 1, close - open - 1);
+                    if (!std::ifstream(includeFileName).good()) {
+                        std::cout << "Shader include not found: " << includeFileName << std::endl;
+                    }
+                    output << readShaderFile(includeFileName) << "\n";
+                    continue;
+                }
+            }
+
+            output << line << "\n";
+        }
+
+        return output.str();
+    }
+    
+    std::string Shader::injectDefines(std::string source, const std::vector<std::string>& defines) {
+
+        if (defines.empty()) {
+            return source;
+        }
+
+        std::string defineBlock;
+        for (const std::string& define : defines) {
+            defineBlock += "#define " + define + "\n";
+        }
+
+        //#version has to stay the first statement, so the defines go right after it
+        size_t versionPos = source.find("#version");
+        size_t insertPos = 0;
+        if (versionPos != std::string::npos) {
+            size_t lineEnd = source.find('\n', versionPos);
+            insertPos = (lineEnd == std::string::npos) ? source.size() : lineEnd + 1;
+        }
+
+        source.insert(insertPos, defineBlock);
+        return source;
     }
     
     void Shader::shaderCompileLog(GLuint shaderId) {
@@ -45,7 +118,7 @@ namespace gps {
         }
     }
     
-    void Shader::shaderLinkLog(GLuint shaderProgramId) {
+    bool Shader::shaderLinkLog(GLuint shaderProgramId) {
 
         GLint success;
         GLchar infoLog[512];
@@ -53,42 +126,159 @@ namespace gps {
         //check linking info
         glGetProgramiv(shaderProgramId, GL_LINK_STATUS, &success);
         if(!success) {
-            glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+            glGetProgramInfoLog(shaderProgramId, 512, NULL, infoLog);
             std::cout << "Shader linking error\n" << infoLog << std::endl;
         }
+        return success == GL_TRUE;
     }
     
     void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName) {
 
-        //read, parse and compile the vertex shader
-        std::string v = readShaderFile(vertexShaderFileName);
-        const GLchar* vertexShaderString = v.c_str();
-        GLuint vertexShader;
-        vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
-        glCompileShader(vertexShader);
-        //check compilation status
-        shaderCompileLog(vertexShader);
+        loadShader(vertexShaderFileName, fragmentShaderFileName, std::vector<std::string>());
+    }
+
+    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::vector<std::string> defines) {
+
+        beginLoad(vertexShaderFileName, fragmentShaderFileName, defines);
+        finishLoad();
+    }
+
+    void Shader::beginLoad(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::vector<std::string> defines) {
+
+        this->sources = std::make_shared<Sources>();
+        this->sources->vertexShaderFileName = vertexShaderFileName;
+        this->sources->fragmentShaderFileName = fragmentShaderFileName;
+        this->sources->defines = defines;
+
+        std::string v = injectDefines(readShaderFile(vertexShaderFileName), defines);
+        std::string f = injectDefines(readShaderFile(fragmentShaderFileName), defines);
+
+        this->pendingLink = std::make_shared<PendingLink>();
+        this->shaderProgram = startLink(v, f, *this->pendingLink);
+    }
+
+    bool Shader::isLoadComplete() const {
+
+        return !this->pendingLink || isLinkComplete(this->shaderProgram, *this->pendingLink);
+    }
+
+    void Shader::finishLoad() {
+
+        if (this->pendingLink) {
+            completeLink(this->shaderProgram, *this->pendingLink);
+            this->pendingLink.reset();
+        }
+    }
+
+    void Shader::enableParallelCompile() {
+
+#if !defined (__APPLE__)
+        //0xFFFFFFFF leaves the thread count to the driver
+        if (GLEW_KHR_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        } else if (GLEW_ARB_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        }
+#endif
+    }
+
+    bool Shader::hasParallelCompile() {
+
+#if defined (__APPLE__)
+        return false;
+#else
+        return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+#endif
+    }
+
+    GLuint Shader::startLink(const std::string& vertexSource, const std::string& fragmentSource, PendingLink& link) {
+
+        //a binary cached by an earlier run skips compiling and linking altogether
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        GLuint program = glCreateProgram();
+        if (ProgramCache::load(program, vertexSource, fragmentSource)) {
+            ProgramCache::getStats().loadMs += elapsedMs(start);
+            return program;
+        }
+
+        //compile the vertex shader
+        const GLchar* vertexShaderString = vertexSource.c_str();
+        link.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(link.vertexShader, 1, &vertexShaderString, NULL);
+        glCompileShader(link.vertexShader);
         
-        //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
-        const GLchar* fragmentShaderString = f.c_str();
-        GLuint fragmentShader;
-        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
-        glCompileShader(fragmentShader);
-        //check compilation status
-        shaderCompileLog(fragmentShader);
+        //compile the fragment shader
+        const GLchar* fragmentShaderString = fragmentSource.c_str();
+        link.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(link.fragmentShader, 1, &fragmentShaderString, NULL);
+        glCompileShader(link.fragmentShader);
         
-        //attach and link the shader programs
-        this->shaderProgram = glCreateProgram();
-        glAttachShader(this->shaderProgram, vertexShader);
-        glAttachShader(this->shaderProgram, fragmentShader);
-        glLinkProgram(this->shaderProgram);
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
+        //attach and link the shader programs; any status query before completeLink() would wait for the compiler
+        glAttachShader(program, link.vertexShader);
+        glAttachShader(program, link.fragmentShader);
+        if (ProgramCache::isEnabled()) {
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(program);
+
+        link.vertexSource = vertexSource;
+        link.fragmentSource = fragmentSource;
+        ProgramCache::getStats().compileMs += elapsedMs(start);
+        return program;
+    }
+
+    bool Shader::completeLink(GLuint program, PendingLink& link) {
+
+        //loaded from the cache, which only accepts binaries that link
+        if (link.vertexShader == 0) {
+            return true;
+        }
+
+        //time spent here is time the main thread waited for the driver
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        //check compilation status
+        shaderCompileLog(link.vertexShader);
+        shaderCompileLog(link.fragmentShader);
         //check linking info
-        shaderLinkLog(this->shaderProgram);
+        bool linked = shaderLinkLog(program);
+        glDeleteShader(link.vertexShader);
+        glDeleteShader(link.fragmentShader);
+        ProgramCache::getStats().compileMs += elapsedMs(start);
+        ProgramCache::getStats().compiled++;
+
+        if (linked) {
+            ProgramCache::store(program, link.vertexSource, link.fragmentSource);
+        }
+        link = PendingLink();
+        return linked;
+    }
+
+    void Shader::discardLink(GLuint program, PendingLink& link) {
+
+        if (link.vertexShader != 0) {
+            glDeleteShader(link.vertexShader);
+            glDeleteShader(link.fragmentShader);
+        }
+        deleteProgram(program);
+        link = PendingLink();
+    }
+
+    bool Shader::isLinkComplete(GLuint program, const PendingLink& link) {
+
+        if (link.vertexShader == 0 || !hasParallelCompile()) {
+            return true;
+        }
+
+        GLint completed = GL_TRUE;
+#if !defined (__APPLE__)
+        glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &completed);
+#endif
+        return completed == GL_TRUE;
+    }
+
+    double Shader::elapsedMs(std::chrono::steady_clock::time_point start) {
+
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
     }
     
     void Shader::useShaderProgram() {
@@ -96,4 +286,317 @@ namespace gps {
         glUseProgram(this->shaderProgram);
     }
 
+    void Shader::loadPermutations(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::vector<std::string> defines,
+        std::vector<ShaderFeature> features, std::function<void(Shader&, bool compiled)> setup) {
+
+        this->permutations = std::make_shared<Permutations>();
+        this->permutations->vertexShaderFileName = vertexShaderFileName;
+        this->permutations->fragmentShaderFileName = fragmentShaderFileName;
+        this->permutations->defines = defines;
+        this->permutations->features = features;
+        this->permutations->setup = setup;
+        this->sources = std::make_shared<Sources>();
+        this->shaderProgram = 0;
+    }
+
+    void Shader::prepareVariant(uint32_t key) {
+
+        if (!this->permutations || this->permutations->variants.count(key) != 0) {
+            return;
+        }
+
+        Permutations& permutations = *this->permutations;
+        Variant variant;
+        variant.ready = false;
+        variant.selected = false;
+        variant.reloadProgram = 0;
+        std::vector<std::string> defines = variantDefines(key, variant.description);
+
+        std::string v = injectDefines(readShaderFile(permutations.vertexShaderFileName), defines);
+        std::string f = injectDefines(readShaderFile(permutations.fragmentShaderFileName), defines);
+        variant.program = startLink(v, f, variant.link);
+        permutations.variants.insert(std::make_pair(key, variant));
+    }
+
+    std::vector<std::string> Shader::variantDefines(uint32_t key, std::string& description) const {
+
+        std::vector<std::string> defines = this->permutations->defines;
+        description.clear();
+        int shift = 0;
+
+        for (const ShaderFeature& feature : this->permutations->features) {
+
+            uint32_t value = (key >> shift) & ((1u << feature.bits) - 1);
+            shift += feature.bits;
+
+            if (feature.bits == 1) {
+                if (value == 0) {
+                    continue;
+                }
+                defines.push_back(feature.name);
+            } else {
+                defines.push_back(feature.name + " " + std::to_string(value));
+            }
+            description += " " + defines.back();
+        }
+
+        return defines;
+    }
+
+    void Shader::selectVariant(uint32_t key) {
+
+        if (!this->permutations) {
+            return;
+        }
+
+        prepareVariant(key);
+
+        Permutations& permutations = *this->permutations;
+        Variant& variant = permutations.variants.find(key)->second;
+        bool compiled = false;
+
+        //first use: wait for the driver if it is still building the variant
+        if (!variant.selected) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            completeLink(variant.program, variant.link);
+            std::cout << "Shader variant " << permutations.fragmentShaderFileName << " [" << variant.description << " ] ready after "
+                << elapsedMs(start) << " ms" << std::endl;
+            variant.selected = true;
+            compiled = true;
+        }
+
+        this->shaderProgram = variant.program;
+        this->variantKey = key;
+
+        if (!variant.ready) {
+            variant.ready = true;
+            if (permutations.setup) {
+                permutations.setup(*this, compiled);
+            }
+        }
+    }
+
+    void Shader::invalidateVariants() {
+
+        if (!this->permutations) {
+            return;
+        }
+
+        for (std::map<uint32_t, Variant>::iterator variant = this->permutations->variants.begin(); variant != this->permutations->variants.end(); ++variant) {
+            variant->second.ready = false;
+        }
+    }
+
+    void Shader::deleteVariants() {
+
+        if (!this->permutations) {
+            return;
+        }
+
+        for (std::map<uint32_t, Variant>::iterator variant = this->permutations->variants.begin(); variant != this->permutations->variants.end(); ++variant) {
+            discardLink(variant->second.program, variant->second.link);
+            if (variant->second.reloadProgram != 0) {
+                discardLink(variant->second.reloadProgram, variant->second.reloadLink);
+            }
+        }
+        if (this->sources) {
+            this->sources->reloading = false;
+        }
+        this->permutations->variants.clear();
+        this->shaderProgram = 0;
+    }
+
+    uint32_t Shader::featureValue(const std::string& name, uint32_t value) const {
+
+        if (!this->permutations) {
+            return 0;
+        }
+
+        int shift = 0;
+        for (const ShaderFeature& feature : this->permutations->features) {
+            if (feature.name == name) {
+                return (value & ((1u << feature.bits) - 1)) << shift;
+            }
+            shift += feature.bits;
+        }
+        return 0;
+    }
+
+    uint32_t Shader::getFeatureMask(const std::string& name) const {
+
+        return featureValue(name, ~0u);
+    }
+
+    uint32_t Shader::getVariantKey() const {
+
+        return this->variantKey;
+    }
+
+    int Shader::getVariantCount() const {
+
+        return this->permutations ? (int)this->permutations->variants.size() : 0;
+    }
+
+    bool Shader::dependsOn(const std::string& fileName) const {
+
+        return this->sources && std::find(this->sources->files.begin(), this->sources->files.end(), fileName) != this->sources->files.end();
+    }
+
+    void Shader::beginReload() {
+
+        if (!this->sources) {
+            return;
+        }
+        Sources& sources = *this->sources;
+
+        if (sources.reloading) {
+            if (this->permutations) {
+                for (std::map<uint32_t, Variant>::iterator variant = this->permutations->variants.begin(); variant != this->permutations->variants.end(); ++variant) {
+                    discardLink(variant->second.reloadProgram, variant->second.reloadLink);
+                    variant->second.reloadProgram = 0;
+                }
+            } else {
+                discardLink(sources.reloadProgram, sources.reloadLink);
+                sources.reloadProgram = 0;
+            }
+        }
+
+        //an edit can add or drop includes
+        sources.files.clear();
+        sources.reloading = true;
+
+        if (!this->permutations) {
+            std::string v = injectDefines(readShaderFile(sources.vertexShaderFileName), sources.defines);
+            std::string f = injectDefines(readShaderFile(sources.fragmentShaderFileName), sources.defines);
+            sources.reloadProgram = startLink(v, f, sources.reloadLink);
+            return;
+        }
+
+        Permutations& permutations = *this->permutations;
+        std::map<uint32_t, Variant>::iterator variant = permutations.variants.begin();
+        while (variant != permutations.variants.end()) {
+
+            //never used yet: drop it, it gets built from the new sources when it is first needed
+            if (!variant->second.selected) {
+                discardLink(variant->second.program, variant->second.link);
+                variant = permutations.variants.erase(variant);
+                continue;
+            }
+
+            std::string description;
+            std::vector<std::string> defines = variantDefines(variant->first, description);
+            std::string v = injectDefines(readShaderFile(permutations.vertexShaderFileName), defines);
+            std::string f = injectDefines(readShaderFile(permutations.fragmentShaderFileName), defines);
+            variant->second.reloadProgram = startLink(v, f, variant->second.reloadLink);
+            ++variant;
+        }
+
+        //the sources are read even if no variant is built, so the files stay watched
+        if (permutations.variants.empty()) {
+            readShaderFile(permutations.vertexShaderFileName);
+            readShaderFile(permutations.fragmentShaderFileName);
+        }
+    }
+
+    bool Shader::updateReload() {
+
+        if (!this->sources || !this->sources->reloading) {
+            return false;
+        }
+        Sources& sources = *this->sources;
+
+        std::string name = this->permutations ? this->permutations->fragmentShaderFileName : sources.fragmentShaderFileName;
+
+        if (!this->permutations) {
+
+            if (!isLinkComplete(sources.reloadProgram, sources.reloadLink)) {
+                return false;
+            }
+            sources.reloading = false;
+
+            if (!completeLink(sources.reloadProgram, sources.reloadLink)) {
+                std::cout << "Shader reload of " << name << " failed, the previous program stays in use" << std::endl;
+                deleteProgram(sources.reloadProgram);
+                sources.reloadProgram = 0;
+                return false;
+            }
+
+            deleteProgram(this->shaderProgram);
+            this->shaderProgram = sources.reloadProgram;
+            sources.reloadProgram = 0;
+            std::cout << "Shader reloaded: " << name << std::endl;
+            return true;
+        }
+
+        std::map<uint32_t, Variant>& variants = this->permutations->variants;
+        for (std::map<uint32_t, Variant>::iterator variant = variants.begin(); variant != variants.end(); ++variant) {
+            if (!isLinkComplete(variant->second.reloadProgram, variant->second.reloadLink)) {
+                return false;
+            }
+        }
+        sources.reloading = false;
+
+        //every variant is checked so all their errors get logged
+        bool linked = true;
+        for (std::map<uint32_t, Variant>::iterator variant = variants.begin(); variant != variants.end(); ++variant) {
+            if (variant->second.reloadProgram != 0) {
+                linked = completeLink(variant->second.reloadProgram, variant->second.reloadLink) && linked;
+            }
+        }
+
+        for (std::map<uint32_t, Variant>::iterator variant = variants.begin(); variant != variants.end(); ++variant) {
+            //variants first prepared during the reload were built from the new sources already
+            if (variant->second.reloadProgram == 0) {
+                continue;
+            }
+            if (linked) {
+                deleteProgram(variant->second.program);
+                variant->second.program = variant->second.reloadProgram;
+                //the next selectVariant() runs setup as for a freshly compiled variant
+                variant->second.selected = false;
+                variant->second.ready = false;
+            } else {
+                deleteProgram(variant->second.reloadProgram);
+            }
+            variant->second.reloadProgram = 0;
+        }
+
+        if (!linked) {
+            std::cout << "Shader reload of " << name << " failed, the previous variants stay in use" << std::endl;
+            return false;
+        }
+
+        std::map<uint32_t, Variant>::iterator current = variants.find(this->variantKey);
+        if (current != variants.end()) {
+            this->shaderProgram = current->second.program;
+        }
+        std::cout << "Shader reloaded: " << name << " (" << variants.size() << " variants)" << std::endl;
+        return true;
+    }
+
+    GLint Shader::getUniformLocation(const char* name) const {
+
+        return getUniformLocation(this->shaderProgram, name);
+    }
+
+    GLint Shader::getUniformLocation(GLuint program, const char* name) {
+
+        std::vector<UniformLocation>& locations = uniformLocations[program];
+        for (const UniformLocation& entry : locations) {
+            if (strcmp(entry.name.c_str(), name) == 0) {
+                return entry.location;
+            }
+        }
+
+        GLint location = glGetUniformLocation(program, name);
+        locations.push_back({ name, location });
+        return location;
+    }
+
+    void Shader::deleteProgram(GLuint program) {
+
+        uniformLocations.erase(program);
+        glDeleteProgram(program);
+    }
+
 }
@@ -17,24 +17,154 @@
     #include <GL/glew.h>
 #endif
 
+#include "ProgramCache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
 #include <sstream>
 #include <iostream>
+#include <string>
+#include <vector>
 
 
 namespace gps {
+
+    //one field of a permutation key, lowest bits first: a flag (bits == 1) adds "#define NAME" when set,
+    //a wider field always adds "#define NAME <value>"
+    struct ShaderFeature {
+        std::string name;
+        int bits;
+    };
     
     class Shader {
 
     public:
         GLuint shaderProgram;
         void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
+        //same as above, with a "#define <name>" injected into both stages for each entry;
+        //programs come from gps::ProgramCache when it holds a binary for the resulting sources
+        void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::vector<std::string> defines);
         void useShaderProgram();
+
+        //loadShader in two halves: beginLoad submits the compile and link without asking for their results,
+        //so the driver can work on them (on its own threads with KHR_parallel_shader_compile) while the
+        //caller does something else; shaderProgram is usable after finishLoad()
+        void beginLoad(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::vector<std::string> defines);
+        //true once finishLoad() won't wait; without the extension there is no way to tell, so always true
+        bool isLoadComplete() const;
+        void finishLoad();
+
+        //lets the driver pick its compiler thread count; needs a current context
+        static void enableParallelCompile();
+        static bool hasParallelCompile();
+
+        //permutations: the variant for each key is compiled the first time it is prepared or selected and kept;
+        //defines go into every variant. setup runs on a variant's first selection after it was compiled
+        //(compiled == true) or after invalidateVariants(), to send the uniforms the variant needs
+        void loadPermutations(std::string vertexShaderFileName, std::string fragmentShaderFileName, std::vector<std::string> defines,
+            std::vector<ShaderFeature> features, std::function<void(Shader&, bool compiled)> setup);
+        //makes shaderProgram the variant for key; copies of this shader share the compiled variants
+        void selectVariant(uint32_t key);
+        //submits the variant for key like beginLoad, so a later selectVariant() finds it built
+        void prepareVariant(uint32_t key);
+        void invalidateVariants();
+        void deleteVariants();
+
+        //value placed in the named field of a key, 0 if the shader has no such feature
+        uint32_t featureValue(const std::string& name, uint32_t value) const;
+        uint32_t getFeatureMask(const std::string& name) const;
+        uint32_t getVariantKey() const;
+        int getVariantCount() const;
+
+        //hot reload: true if fileName (as the shader opened it, e.g. "shaders/lighting.glsl") went into
+        //the last build, #includes too
+        bool dependsOn(const std::string& fileName) const;
+        //rebuilds from the files on disk like beginLoad; the current program stays in use meanwhile,
+        //a rebuild already running is dropped
+        void beginReload();
+        //call every frame: once the rebuild is done, swaps in the new program (every variant, or none) and
+        //returns true, or logs the errors and keeps the old one
+        bool updateReload();
+
+        //glGetUniformLocation of the current program, looked up once per program and name: draws ask for
+        //their locations every time and get them from the cache, which lives until the program is deleted
+        GLint getUniformLocation(const char* name) const;
+        static GLint getUniformLocation(GLuint program, const char* name);
+        //glDeleteProgram, dropping the cached locations since the driver may hand the name out again
+        static void deleteProgram(GLuint program);
     
     private:
+        //a link submitted by beginLoad that nobody has checked yet; no shaders means there is none
+        struct PendingLink {
+            GLuint vertexShader = 0;
+            GLuint fragmentShader = 0;
+            //kept for the program cache key
+            std::string vertexSource;
+            std::string fragmentSource;
+        };
+
+        struct Variant {
+            GLuint program;
+            //setup has run since the last invalidateVariants()
+            bool ready;
+            //selected at least once, so the link was checked
+            bool selected;
+            PendingLink link;
+            //the feature defines, for the log
+            std::string description;
+            GLuint reloadProgram;
+            PendingLink reloadLink;
+        };
+
+        struct Permutations {
+            std::string vertexShaderFileName;
+            std::string fragmentShaderFileName;
+            std::vector<std::string> defines;
+            std::vector<ShaderFeature> features;
+            std::function<void(Shader&, bool)> setup;
+            std::map<uint32_t, Variant> variants;
+        };
+
+        std::shared_ptr<Permutations> permutations;
+        uint32_t variantKey = 0;
+        //only between beginLoad() and finishLoad(), so copies of a loaded shader don't carry the sources
+        std::shared_ptr<PendingLink> pendingLink;
+
+        //what the last beginLoad() or loadPermutations() built from, for reloads; shared, so the copies
+        //the draw paths take stay a program, a key and reference-counted pointers, with nothing to allocate
+        struct Sources {
+            std::string vertexShaderFileName;
+            std::string fragmentShaderFileName;
+            std::vector<std::string> defines;
+            //every file read, #includes too
+            std::vector<std::string> files;
+            bool reloading = false;
+            GLuint reloadProgram = 0;
+            PendingLink reloadLink;
+        };
+
+        std::shared_ptr<Sources> sources;
+
         std::string readShaderFile(std::string fileName);
+        std::string resolveIncludes(std::string source, std::string fileName);
+        std::string injectDefines(std::string source, const std::vector<std::string>& defines);
         void shaderCompileLog(GLuint shaderId);
-        void shaderLinkLog(GLuint shaderProgramId);
+        //true if the program linked
+        bool shaderLinkLog(GLuint shaderProgramId);
+        //creates program and either loads it from the cache or starts compiling into link
+        GLuint startLink(const std::string& vertexSource, const std::string& fragmentSource, PendingLink& link);
+        //waits for the link if needed, reports errors and caches the binary; true if the program is usable
+        bool completeLink(GLuint program, PendingLink& link);
+        void discardLink(GLuint program, PendingLink& link);
+        //base defines plus the ones key selects
+        std::vector<std::string> variantDefines(uint32_t key, std::string& description) const;
+        static bool isLinkComplete(GLuint program, const PendingLink& link);
+        static double elapsedMs(std::chrono::steady_clock::time_point start);
     };
     
 }
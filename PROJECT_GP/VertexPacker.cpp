@@ -0,0 +1,159 @@
+#include "VertexPacker.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace gps {
+
+    namespace {
+
+        float signNotZero(float value) {
+            return value >= 0.0f ? 1.0f : -1.0f;
+        }
+
+        //unit normal onto the octahedron, the lower half folded over the diagonals
+        glm::vec2 encodeOctahedral(glm::vec3 normal) {
+
+            float sum = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+            if (sum <= 0.0f) {
+                return glm::vec2(0.0f);
+            }
+
+            glm::vec3 n = normal / sum;
+            if (n.z < 0.0f) {
+                return glm::vec2((1.0f - std::fabs(n.y)) * signNotZero(n.x), (1.0f - std::fabs(n.x)) * signNotZero(n.y));
+            }
+            return glm::vec2(n.x, n.y);
+        }
+
+        //same as decodeNormal() in packedVertex.glsl
+        glm::vec3 decodeOctahedral(glm::vec2 e) {
+
+            glm::vec3 n(e.x, e.y, 1.0f - std::fabs(e.x) - std::fabs(e.y));
+            if (n.z < 0.0f) {
+                n = glm::vec3((1.0f - std::fabs(e.y)) * signNotZero(e.x), (1.0f - std::fabs(e.x)) * signNotZero(e.y), n.z);
+            }
+            return glm::normalize(n);
+        }
+
+        GLshort toSnorm16(float value) {
+            return (GLshort)std::lround(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f);
+        }
+
+        //GL's signed normalized conversion: max(c / 32767, -1)
+        float fromSnorm16(GLshort value) {
+            return std::max(value / 32767.0f, -1.0f);
+        }
+    }
+
+    void VertexPacker::pack(const std::vector<Vertex>& vertices, std::vector<PackedVertex>& packed,
+        glm::vec3& positionScale, glm::vec3& positionBias, QuantizationError& error) {
+
+        packed.resize(vertices.size());
+        error = QuantizationError();
+
+        glm::vec3 boxMin(0.0f), boxMax(0.0f);
+        if (!vertices.empty()) {
+            boxMin = boxMax = vertices[0].Position;
+        }
+        for (size_t i = 1; i < vertices.size(); i++) {
+            boxMin = glm::min(boxMin, vertices[i].Position);
+            boxMax = glm::max(boxMax, vertices[i].Position);
+        }
+
+        positionBias = boxMin;
+        positionScale = boxMax - boxMin;
+
+        for (size_t i = 0; i < vertices.size(); i++) {
+
+            const Vertex& vertex = vertices[i];
+            PackedVertex& out = packed[i];
+            glm::vec3 decodedPosition;
+
+            for (int k = 0; k < 3; k++) {
+                float t = positionScale[k] > 0.0f ? (vertex.Position[k] - positionBias[k]) / positionScale[k] : 0.0f;
+                out.position[k] = (GLushort)std::lround(std::min(std::max(t, 0.0f), 1.0f) * 65535.0f);
+                decodedPosition[k] = positionBias[k] + positionScale[k] * (out.position[k] / 65535.0f);
+            }
+            out.padding = 0;
+
+            glm::vec2 octahedral = encodeOctahedral(vertex.Normal);
+            out.normal[0] = toSnorm16(octahedral.x);
+            out.normal[1] = toSnorm16(octahedral.y);
+
+            out.texCoords[0] = floatToHalf(vertex.TexCoords.x);
+            out.texCoords[1] = floatToHalf(vertex.TexCoords.y);
+
+            //measure against what the shader will reconstruct
+            error.position = std::max(error.position, glm::length(decodedPosition - vertex.Position));
+
+            float normalLength = glm::length(vertex.Normal);
+            if (normalLength > 0.0f) {
+                glm::vec3 decodedNormal = decodeOctahedral(glm::vec2(fromSnorm16(out.normal[0]), fromSnorm16(out.normal[1])));
+                float cosine = std::min(std::max(glm::dot(decodedNormal, vertex.Normal / normalLength), -1.0f), 1.0f);
+                error.normalDegrees = std::max(error.normalDegrees, std::acos(cosine) * 57.2957795f);
+            }
+
+            error.texCoords = std::max(error.texCoords, std::max(
+                std::fabs(halfToFloat(out.texCoords[0]) - vertex.TexCoords.x),
+                std::fabs(halfToFloat(out.texCoords[1]) - vertex.TexCoords.y)));
+        }
+    }
+
+    // round to nearest; out of range values become infinity, tiny ones denormals or zero
+    GLushort VertexPacker::floatToHalf(float value) {
+
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        uint32_t sign = (bits >> 16) & 0x8000u;
+        uint32_t exponentBits = (bits >> 23) & 0xffu;
+        uint32_t mantissa = bits & 0x7fffffu;
+
+        if (exponentBits == 0xffu) {
+            return (GLushort)(sign | 0x7c00u | (mantissa ? 0x200u : 0u));
+        }
+
+        int exponent = (int)exponentBits - 127 + 15;
+        if (exponent >= 31) {
+            return (GLushort)(sign | 0x7c00u);
+        }
+
+        if (exponent <= 0) {
+            if (exponent < -10) {
+                return (GLushort)sign;
+            }
+            mantissa |= 0x800000u;
+            int shift = 14 - exponent;
+            uint32_t half = mantissa >> shift;
+            if ((mantissa >> (shift - 1)) & 1u) {
+                half++;
+            }
+            return (GLushort)(sign | half);
+        }
+
+        //a carry out of the mantissa correctly bumps the exponent
+        uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+        if (mantissa & 0x1000u) {
+            half++;
+        }
+        return (GLushort)half;
+    }
+
+    float VertexPacker::halfToFloat(GLushort half) {
+
+        float sign = (half & 0x8000u) ? -1.0f : 1.0f;
+        int exponent = (half >> 10) & 0x1f;
+        int mantissa = half & 0x3ff;
+
+        if (exponent == 0) {
+            return sign * std::ldexp((float)mantissa, -24);
+        }
+        if (exponent == 31) {
+            return mantissa ? NAN : sign * INFINITY;
+        }
+        return sign * std::ldexp((float)(mantissa | 0x400), exponent - 25);
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef VertexPacker_hpp
+#define VertexPacker_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // 16 byte vertex: position as 16 bit unsigned normalized inside the mesh's box,
+    // octahedral normal as two 16 bit signed normalized values, texture coordinates as half floats
+    struct PackedVertex {
+        GLushort position[3];
+        GLushort padding;
+        GLshort normal[2];
+        GLushort texCoords[2];
+    };
+
+    class VertexPacker {
+
+    public:
+        //position = positionBias + positionScale * packed position / 65535, see shaders/packedVertex.glsl
+        static void pack(const std::vector<Vertex>& vertices, std::vector<PackedVertex>& packed,
+            glm::vec3& positionScale, glm::vec3& positionBias, QuantizationError& error);
+
+        static GLushort floatToHalf(float value);
+        static float halfToFloat(GLushort half);
+    };
+}
+
+#endif /* VertexPacker_hpp */
@@ -1,8 +1,11 @@
 #include "Window.h"
 
+#include <algorithm>
+#include <cstring>
+
 namespace gps {
 
-    void Window::Create(int width, int height, const char *title) {
+    void Window::Create(int width, int height, const char *title, bool visible) {
         if (!glfwInit()) {
             throw std::runtime_error("Could not start GLFW3!");
         }
@@ -20,7 +23,9 @@ namespace gps {
         glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
 
         //for antialising
-        glfwWindowHint(GLFW_SAMPLES, 4);
+        glfwWindowHint(GLFW_SAMPLES, SAMPLES);
+
+        glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 
         this->window = glfwCreateWindow(width, height, title, NULL, NULL);
         if (!this->window) {
@@ -31,10 +36,101 @@ namespace gps {
 
         glfwSwapInterval(1);
 
+        initGLFunctions();
+
+        //for RETINA display
+        glfwGetFramebufferSize(window, &this->dimensions.width, &this->dimensions.height);
+        startTime = std::chrono::steady_clock::now();
+    }
+
+    void Window::CreateOffscreen(int width, int height) {
+#if defined (GPS_EGL)
+        createEglContext();
+        initGLFunctions();
+#else
+        Create(width, height, "OpenGL Project (offscreen)", false);
+#endif
+        offscreen = true;
+        this->dimensions.width = width;
+        this->dimensions.height = height;
+        createFramebuffer();
+        startTime = std::chrono::steady_clock::now();
+        std::cout << "Rendering offscreen into a " << width << "x" << height << " framebuffer" << std::endl;
+    }
+
+#if defined (GPS_EGL)
+    void Window::createEglContext() {
+        //Mesa's surfaceless platform needs neither X11 nor a GPU (llvmpipe); other drivers get the default display
+        const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay && clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+            eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+        if (eglDisplay == EGL_NO_DISPLAY) {
+            eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        }
+
+        EGLint major, minor;
+        if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor)) {
+            throw std::runtime_error("Could not initialize EGL!");
+        }
+
+        const char* extensions = eglQueryString(eglDisplay, EGL_EXTENSIONS);
+        if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context")) {
+            throw std::runtime_error("EGL display has no EGL_KHR_surfaceless_context!");
+        }
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            throw std::runtime_error("EGL has no desktop OpenGL!");
+        }
+
+        //no surface is ever created, so any surface type will do
+        const EGLint configAttributes[] = {
+            EGL_SURFACE_TYPE, 0,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(eglDisplay, configAttributes, &config, 1, &configCount) || configCount == 0) {
+            throw std::runtime_error("No EGL config for desktop OpenGL!");
+        }
+
+        //same version and profile as the GLFW window
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 1,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE, EGL_TRUE,
+            EGL_NONE
+        };
+        eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+        if (eglContext == EGL_NO_CONTEXT) {
+            throw std::runtime_error("Could not create an OpenGL 4.1 core EGL context!");
+        }
+        if (!eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+            throw std::runtime_error("Could not make the EGL context current!");
+        }
+
+        std::cout << "EGL " << major << "." << minor << ", surfaceless context" << std::endl;
+    }
+#endif
+
+    void Window::initGLFunctions() {
 #if not defined (__APPLE__)
         // start GLEW extension handler
         glewExperimental = GL_TRUE;
+#if defined (GPS_EGL)
+        //glewInit also wants a GLX display, which an EGL context doesn't have; the GL entry points
+        //come from glewContextInit alone
+        if (!window) {
+            glewContextInit();
+        } else {
+            glewInit();
+        }
+#else
         glewInit();
+#endif
 #endif
 
         // get version info
@@ -42,12 +138,67 @@ namespace gps {
         const GLubyte* version = glGetString(GL_VERSION); // version as a string
         std::cout << "Renderer: " << renderer << std::endl;
         std::cout << "OpenGL version: " << version << std::endl;
+    }
 
-        //for RETINA display
-        glfwGetFramebufferSize(window, &this->dimensions.width, &this->dimensions.height);
+    void Window::createFramebuffer() {
+        //sRGB and multisampled like the window's default framebuffer, so offscreen runs measure what players see
+        GLint maxSamples = SAMPLES;
+        glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+        int samples = std::min(SAMPLES, (int)maxSamples);
+
+        glGenRenderbuffers(1, &colorRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorRenderbuffer);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_SRGB8_ALPHA8, dimensions.width, dimensions.height);
+
+        glGenRenderbuffers(1, &depthRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH24_STENCIL8, dimensions.width, dimensions.height);
+
+        glGenRenderbuffers(1, &resolvedRenderbuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, resolvedRenderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_SRGB8_ALPHA8, dimensions.width, dimensions.height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &resolvedFramebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, resolvedFramebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, resolvedRenderbuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            throw std::runtime_error("Offscreen resolve framebuffer is incomplete!");
+        }
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRenderbuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            throw std::runtime_error("Offscreen framebuffer is incomplete!");
+        }
+        std::cout << "Offscreen framebuffer: " << samples << "x MSAA" << std::endl;
     }
 
     void Window::Delete() {
+        if (framebuffer) {
+            glDeleteFramebuffers(1, &framebuffer);
+            glDeleteRenderbuffers(1, &colorRenderbuffer);
+            glDeleteRenderbuffers(1, &depthRenderbuffer);
+            glDeleteFramebuffers(1, &resolvedFramebuffer);
+            glDeleteRenderbuffers(1, &resolvedRenderbuffer);
+            framebuffer = 0;
+        }
+
+#if defined (GPS_EGL)
+        if (eglDisplay != EGL_NO_DISPLAY) {
+            eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (eglContext != EGL_NO_CONTEXT)
+                eglDestroyContext(eglDisplay, eglContext);
+            eglTerminate(eglDisplay);
+            eglDisplay = EGL_NO_DISPLAY;
+            eglContext = EGL_NO_CONTEXT;
+            return;
+        }
+#endif
+
         if (window)
             glfwDestroyWindow(window);
         //close GL context and any other GLFW resources
@@ -65,4 +216,63 @@ namespace gps {
     void Window::setWindowDimensions(WindowDimensions dimensions) {
         this->dimensions = dimensions;
     }
+
+    bool Window::isOffscreen() {
+        return offscreen;
+    }
+
+    GLuint Window::getFramebuffer() {
+        return framebuffer;
+    }
+
+    GLuint Window::resolveFramebuffer() {
+        if (!offscreen) {
+            return 0;
+        }
+
+        GLint readFramebuffer, drawFramebuffer;
+        glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolvedFramebuffer);
+        glBlitFramebuffer(0, 0, dimensions.width, dimensions.height, 0, 0, dimensions.width, dimensions.height,
+            GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+        return resolvedFramebuffer;
+    }
+
+    bool Window::shouldClose() {
+        return window && glfwWindowShouldClose(window);
+    }
+
+    void Window::swapBuffers() {
+        if (offscreen) {
+            //nothing to present; keep the driver working on the frame like a swap would
+            glFlush();
+        } else {
+            glfwSwapBuffers(window);
+        }
+    }
+
+    void Window::pollEvents() {
+        if (window)
+            glfwPollEvents();
+    }
+
+    void Window::setTitle(const char *title) {
+        if (window && !offscreen)
+            glfwSetWindowTitle(window, title);
+    }
+
+    void Window::setSwapInterval(int interval) {
+        if (window)
+            glfwSwapInterval(interval);
+    }
+
+    double Window::getTime() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    }
 }
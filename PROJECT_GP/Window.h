@@ -11,6 +11,14 @@
 
 #include <GLFW/glfw3.h>
 
+//GPS_EGL (C/C++ -> Preprocessor Definitions, link EGL): offscreen contexts come from surfaceless EGL,
+//without a display server. Elsewhere they are hidden GLFW windows
+#if defined (GPS_EGL)
+    #include <EGL/egl.h>
+    #include <EGL/eglext.h>
+#endif
+
+#include <chrono>
 #include <stdexcept>
 #include <iostream>
 
@@ -24,16 +32,58 @@ namespace gps {
     class Window {
 
     public:
-        void Create(int width=800, int height=600, const char *title="OpenGL Project");
+        //GLFW_SAMPLES of the window, and the sample count of offscreen framebuffers
+        static constexpr int SAMPLES = 4;
+
+        //a hidden window still gets a default framebuffer, for benchmarks that shouldn't pop up
+        void Create(int width=800, int height=600, const char *title="OpenGL Project", bool visible=true);
+        //a 4.1 core context with no window: frames go into a multisampled sRGB framebuffer object of the
+        //given size, with as many samples as the window asks for; bind getFramebuffer() wherever the
+        //default framebuffer would be bound
+        void CreateOffscreen(int width=800, int height=600);
         void Delete();
 
+        //NULL for surfaceless EGL contexts
         GLFWwindow* getWindow();
         WindowDimensions getWindowDimensions();
         void setWindowDimensions(WindowDimensions dimensions);
 
+        bool isOffscreen();
+        //0 for on-screen windows
+        GLuint getFramebuffer();
+        //resolves the offscreen samples into a single-sample framebuffer and returns it, for glReadPixels;
+        //0 for on-screen windows, whose default framebuffer resolves on read
+        GLuint resolveFramebuffer();
+
+        //the GLFW calls the render loop needs, also valid without a GLFW window
+        bool shouldClose();
+        void swapBuffers();
+        void pollEvents();
+        void setTitle(const char *title);
+        void setSwapInterval(int interval);
+        //seconds since Create
+        double getTime();
+
     private:
         WindowDimensions dimensions;
-        GLFWwindow *window;
+        GLFWwindow *window = NULL;
+
+        bool offscreen = false;
+        GLuint framebuffer = 0;
+        GLuint colorRenderbuffer = 0;
+        GLuint depthRenderbuffer = 0;
+        GLuint resolvedFramebuffer = 0;
+        GLuint resolvedRenderbuffer = 0;
+        std::chrono::steady_clock::time_point startTime;
+
+#if defined (GPS_EGL)
+        EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+        EGLContext eglContext = EGL_NO_CONTEXT;
+
+        void createEglContext();
+#endif
+        void initGLFunctions();
+        void createFramebuffer();
     };
 }
 
@@ -20,15 +20,40 @@
 #include "Shader.hpp"
 #include "Camera.hpp"
 #include "Model3D.hpp"
+#include "LightClusters.hpp"
+#include "DeferredRenderer.hpp"
+#include "GpuProfiler.hpp"
+#include "PortalGraph.hpp"
+#include "HiZBuffer.hpp"
+#include "AllocationStats.hpp"
+#include "InstanceBuffer.hpp"
+#include "RingBuffer.hpp"
+#include "FileWatcher.hpp"
+#include "CameraPath.hpp"
+#include "GoldenImage.hpp"
+#include "CpuProfiler.hpp"
 
 //audio
 #include <SFML/Audio.hpp>
 
+#include <filesystem>
 #include <iostream>
+#include <random>
 
 // window
 gps::Window myWindow;
 
+// every random decision goes through this engine: seeded from the clock when playing, from --seed in --benchmark
+std::mt19937 randomEngine;
+
+// uniform in [0, bound)
+int randomInt(int bound) {
+    return std::uniform_int_distribution<int>(0, bound - 1)(randomEngine);
+}
+
+// seconds of scene animation; the wall clock when playing, frame * timestep in --benchmark
+double sceneTime = 0.0;
+
 // matrices
 glm::mat4 model;
 glm::mat4 view;
@@ -39,27 +64,18 @@ glm::mat3 normalMatrix;
 glm::vec3 lightDir;
 glm::vec3 lightColor;
 
-// shader uniform locations
-GLint modelLoc;
-GLint viewLoc;
-GLint projectionLoc;
-GLint normalMatrixLoc;
-GLint lightDirLoc;
-GLint lightColorLoc;
-
 // spotlight (flashlight) parameters
 glm::vec3 spotLightPos;
 glm::vec3 spotLightDir;
 glm::vec3 spotLightColor;
-GLint spotLightPosLoc;
-GLint spotLightDirLoc;
-GLint spotLightColorLoc;
-GLint spotLightCutOffLoc;
-GLint spotLightOuterCutOffLoc;
-GLint spotLightConstantLoc;
-GLint spotLightLinearLoc;
-GLint spotLightQuadraticLoc;
 bool flashlightOn = false;
+//color after flicker, 0 while the flashlight is off
+glm::vec3 currentFlashlightColor;
+float spotLightCutOffAngle = 10.0f;       // Inner cone angle
+float spotLightOuterCutOffAngle = 12.0f;  // Outer cone angle for smooth edges
+float spotLightConstant = 1.0f;
+float spotLightLinear = 0.45f;
+float spotLightQuadratic = 0.75f;
 
 //shadows
 const unsigned int SHADOW_WIDTH = 4096, SHADOW_HEIGHT = 4096;
@@ -72,8 +88,10 @@ glm::mat4 lightMatrices[SHADOW_LAYERS];
 gps::Shader depthMapShader;
 
 glm::mat4 lightSpaceMatrix;
-GLint lightSpaceMatrixLoc;
-GLint shadowMapLoc;
+
+// 0 - 1 tap, 1 - 4 tap rotated Poisson, 2 - 9 tap
+const int SHADOW_QUALITY_LEVELS = 3;
+int shadowQuality = 1;
 
 //candles
 struct PointLight {
@@ -90,15 +108,12 @@ struct PointLight {
     }
 };
 
-#define MAX_POINT_LIGHTS 8
+#define MAX_POINT_LIGHTS gps::LightClusters::MAX_LIGHTS
 std::vector<PointLight> pointLights;
 
-GLint pointLightPosLoc[MAX_POINT_LIGHTS];
-GLint pointLightColorLoc[MAX_POINT_LIGHTS];
-GLint pointLightConstantLoc[MAX_POINT_LIGHTS];
-GLint pointLightLinearLoc[MAX_POINT_LIGHTS];
-GLint pointLightQuadraticLoc[MAX_POINT_LIGHTS];
-GLint numPointLightsLoc;
+// point lights are culled per view cluster instead of looping over all of them per fragment
+gps::LightClusters lightClusters;
+std::vector<gps::ClusterLight> clusterLights;
 
 // camera
 gps::Camera myCamera(
@@ -170,7 +185,7 @@ struct AnimatronicState {
         : name(n), hiddenPosition(hidden), visiblePosition(visible),
         isVisible(false), playedSound(false), moveTimer(0.0f),
         lightIrritation(0.0f), irritationThreshold(5.0f),
-        moveInterval(5.0f + (rand() % 10)) {
+        moveInterval(5.0f + randomInt(10)) {
     }
 
     glm::vec3 getCurrentPosition() const {
@@ -221,7 +236,10 @@ AnimatronicState bonnieState("Bonnie",
     glm::vec3(2.9f, 10.0f, -2.36f),      //off screen
     glm::vec3(2.9f, 0.0f, -2.36f));     // at window
 
-GLfloat cameraSpeed = 0.01f;
+// units per second
+GLfloat cameraSpeed = 0.6f;
+// degrees per second, Q/E
+GLfloat modelTurnSpeed = 60.0f;
 
 GLboolean pressedKeys[1024];
 
@@ -247,6 +265,180 @@ GLfloat angle;
 
 // shaders
 gps::Shader myBasicShader;
+// project into light space per fragment instead of passing fPosLightSpace[5] from basic.vert
+bool lightSpaceInFragment = false;
+
+// deferred shading: G-buffer pass, full-screen moon/flashlight pass, point light volumes
+bool deferredShading = false;
+gps::DeferredRenderer deferredRenderer;
+gps::Shader gBufferShader;
+gps::Shader deferredLightShader;
+gps::Shader deferredPointShader;
+
+// depth pre-pass: lay down depth with a position-only shader, then shade with GL_EQUAL so basic.frag runs once per pixel
+bool depthPrepass = false;
+gps::Shader depthPrepassShader;
+
+// timestamp scopes around every shadow layer, pass and model draw; the passes' times go into the window title,
+// --gpu-profile [file.csv] also logs every scope
+const int GPU_PROFILER_SCOPES = 64;
+const float GPU_PROFILE_LOG_SECONDS = 5.0f;
+gps::GpuProfiler gpuProfiler;
+bool gpuProfile = false;
+std::string gpuProfileCsv;
+float lastProfileLog = 0.0f;
+
+// --cpu-trace file.json: the CPU zones (see CpuProfiler.hpp) are written there on exit, needs GPS_CPU_PROFILER
+std::string cpuTraceFile;
+
+// camera, animatronics, door and flicker advance in fixed steps, whatever the frame rate;
+// frames show the camera, the door and the flicker interpolated between the last two steps
+const double SIMULATION_STEP = 1.0 / 120.0;
+// a longer frame (a breakpoint, a stall) is cut to this many steps so the simulation can't spiral
+const int MAX_SIMULATION_STEPS = 8;
+double simulationTime = 0.0;
+double simulationAccumulator = 0.0;
+gps::CameraPose previousCameraPose;
+gps::CameraPose currentCameraPose;
+// the last step moved the camera through a transition, so its orientation is interpolated too
+bool interpolateCameraOrientation = false;
+
+// what the steps animate smoothly besides the camera; the animatronics jump between their two
+// positions, so they are drawn as stepped
+struct AnimationState {
+    float doorAngle;
+    glm::vec3 candleColors[3];
+};
+AnimationState previousAnimation;
+AnimationState currentAnimation;
+
+// --no-vsync: render as fast as possible, the simulation rate stays the same
+bool vsync = true;
+
+// --benchmark [frames]: a fixed-timestep replay of --camera-path (or a tour of the camera states) with --seed
+const int BENCHMARK_STEPS_PER_FRAME = 2;
+const float BENCHMARK_TIMESTEP = (float)(BENCHMARK_STEPS_PER_FRAME * SIMULATION_STEP);
+const int BENCHMARK_WARMUP_FRAMES = 30;
+const float DEFAULT_PATH_SEGMENT_SECONDS = 3.0f;
+int benchmarkFrames = 0;
+unsigned int benchmarkSeed = 1;
+std::string benchmarkOutFile;
+std::string cameraPathFile;
+gps::CameraPath cameraPath;
+
+// --record-camera-path file: the pose of every frame is appended to the file, for --camera-path
+std::string recordPathFile;
+gps::CameraPath recordedPath;
+
+// --golden dir: every camera state is rendered in a fixed scene and compared with dir/<state name>.png,
+// --golden-update writes the references instead
+std::string goldenDir;
+bool goldenUpdate = false;
+double goldenMinPsnr = 40.0;
+const int GOLDEN_FRAMES = 3;
+const int GOLDEN_DIFF_THRESHOLD = 8;
+float lastTimingUpdate = 0.0f;
+
+// per-mesh frustum culling against projection * view, C toggles
+bool frustumCulling = true;
+int meshesCulled = 0;
+int meshesTotal = 0;
+int shadowMeshesCulled = 0;
+int shadowMeshesTotal = 0;
+// scratch for the per-mesh culling results
+std::vector<uint8_t> meshVisible;
+
+// levels of detail: the coarsest level whose simplification error stays under this many pixels is drawn,
+// shadow maps tolerate more; T tints meshes by the level they were drawn with
+bool generateLods = true;
+float lodPixelError = 1.0f;
+float shadowLodPixelError = 4.0f;
+bool lodTint = false;
+std::vector<uint8_t> meshLods;
+
+// upload 16 byte quantized vertices instead of 32 byte floats, the load log reports the error it introduces
+bool packedVertices = false;
+
+// drop the CPU copies of vertices and indices after upload, --keep-mesh-data keeps them
+bool releaseMeshData = true;
+
+// linked program binaries are kept in shader_cache/ and reused while the sources and driver stay the same
+bool shaderCache = true;
+
+// edited files in shaders/ are rebuilt while the app runs, --no-hot-reload turns the watcher off
+bool hotReload = true;
+gps::FileWatcher shaderWatcher;
+
+// --offscreen: no window, frames go into the window's framebuffer object (surfaceless EGL in GPS_EGL builds)
+bool offscreen = false;
+
+// meshlets: meshes drawn at full detail are cut down to the clusters inside the view that face it, M toggles
+bool meshletCulling = true;
+int meshletsCulled = 0;
+int meshletsTotal = 0;
+std::vector<gps::DrawRanges> meshletRanges;
+
+// --stress-candles N: N more candles on a grid over the bathroom floor, one instanced draw per mesh in every pass;
+// --bench-stress times them against drawing each copy on its own
+int stressCandles = 0;
+bool instanceCandles = true;
+std::vector<glm::mat4> stressCandleModels;
+gps::Bounds candleBounds;
+gps::InstanceBuffer candleInstances;
+// scratch for the copies that pass the culling of the current pass
+std::vector<glm::mat4> visibleCandleModels;
+int candleInstancesDrawn = 0;
+
+// per-frame and per-draw shader data goes through a triple-buffered uniform ring instead of glUniform* calls;
+// the structs mirror the std140 blocks in shaders/frameData.glsl and shaders/drawData.glsl
+const GLuint FRAME_DATA_BINDING = 0;
+const GLuint DRAW_DATA_BINDING = 1;
+const GLsizeiptr UNIFORM_RING_FRAME_BYTES = 4 * 1024 * 1024;
+gps::RingBuffer uniformRing;
+// --no-persistent-ring: glBufferSubData into the ring even where ARB_buffer_storage is available
+bool persistentRing = true;
+
+struct FrameData {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 inverseView;
+    glm::mat4 lightSpaceMatrices[SHADOW_LAYERS];
+    glm::vec3 lightDir;
+    float spotLightCutOff;
+    glm::vec3 lightColor;
+    float spotLightOuterCutOff;
+    glm::vec3 spotLightPos;
+    float spotLightConstant;
+    glm::vec3 spotLightDir;
+    float spotLightLinear;
+    glm::vec3 spotLightColor;
+    float spotLightQuadratic;
+};
+
+struct DrawData {
+    glm::mat4 model;
+    //std140 stores a mat3 as three vec4 columns
+    glm::vec4 normalMatrix[3];
+};
+
+// CPU time from the start of renderScene() to the end of the swap, averaged over the title refresh interval
+double cpuFrameMs = 0.0;
+double cpuFrameMsSum = 0.0;
+int cpuFrameCount = 0;
+
+// cells and portals of the level: anything outside the camera's room is only drawn when seen through the door or window, V toggles
+gps::PortalGraph portalGraph;
+bool portalCulling = true;
+int doorPortal = -1;
+gps::CellVisibility cameraCells;
+// viewpoint of the shadow layer being rendered
+glm::mat4 shadowCasterMatrix;
+gps::CellVisibility shadowCasterCells;
+
+// Hi-Z occlusion culling against an earlier frame's depth, off while the camera jumps between states, H toggles
+gps::HiZBuffer hiZBuffer;
+bool occlusionCulling = true;
+int meshesOccluded = 0;
 
 GLenum glCheckError_(const char *file, int line)
 {
@@ -307,6 +499,43 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
         flashlightClickSound->play(); 
     }
 
+    if (key == GLFW_KEY_C && action == GLFW_PRESS) {
+        frustumCulling = !frustumCulling;
+        std::cout << "Frustum culling: " << (frustumCulling ? "on" : "off") << std::endl;
+    }
+
+    if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+        occlusionCulling = !occlusionCulling;
+        //whatever was captured before is stale by the time it is turned back on
+        hiZBuffer.invalidate();
+        std::cout << "Occlusion culling: " << (occlusionCulling ? "on" : "off") << std::endl;
+    }
+
+    if (key == GLFW_KEY_V && action == GLFW_PRESS) {
+        portalCulling = !portalCulling;
+        std::cout << "Portal culling: " << (portalCulling ? "on" : "off") << std::endl;
+    }
+
+    if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+        meshletCulling = !meshletCulling;
+        std::cout << "Meshlet culling: " << (meshletCulling ? "on" : "off") << std::endl;
+    }
+
+    if (key == GLFW_KEY_T && action == GLFW_PRESS) {
+        lodTint = !lodTint;
+        std::cout << "LOD tint: " << (lodTint ? "on" : "off") << std::endl;
+    }
+
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        depthPrepass = !depthPrepass;
+        std::cout << "Depth pre-pass: " << (depthPrepass ? "on" : "off") << std::endl;
+    }
+
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        shadowQuality = (shadowQuality + 1) % SHADOW_QUALITY_LEVELS;
+        std::cout << "Shadow quality: " << shadowQuality << std::endl;
+    }
+
 	if (key >= 0 && key < 1024) {
         if (action == GLFW_PRESS) {
             pressedKeys[key] = true;
@@ -350,8 +579,6 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
 
     // update view matrix
     view = myCamera.getViewMatrix();
-    myBasicShader.useShaderProgram();
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
     normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 }
 
@@ -382,8 +609,12 @@ void transitionToCamera(int stateIndex) {
 }
 
 void updateCameraTransition(float deltaTime) {
+    PROFILE_ZONE("updateCameraTransition");
     if (!isTransitioning) return;
 
+    //depth from the previous vantage point says nothing about what the new one reveals
+    hiZBuffer.invalidate();
+
     transitionProgress += deltaTime * transitionSpeed;
 
     if (transitionProgress >= 1.0f) {
@@ -408,13 +639,12 @@ void updateCameraTransition(float deltaTime) {
     myCamera.rotate(pitch, yaw);
 
     view = myCamera.getViewMatrix();
-    myBasicShader.useShaderProgram();
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
     
     normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 }
 
 void updateAnimatronics(float deltaTime) {
+    PROFILE_ZONE("updateAnimatronics");
 
     if (!bonnieState.isVisible) {
         bonnieArrivedSoundPlayed = false;
@@ -442,7 +672,7 @@ void updateAnimatronics(float deltaTime) {
     foxyState.moveTimer += deltaTime;
 
     if (foxyState.moveTimer >= foxyState.moveInterval) {
-        if (rand() % 100 < 50) { // 50% chance
+        if (randomInt(100) < 50) { // 50% chance
 
            foxyState.isVisible = true;
            if (!foxyArrivedSoundPlayed) {
@@ -458,14 +688,14 @@ void updateAnimatronics(float deltaTime) {
         }
 
         foxyState.moveTimer = 0.0f;
-        foxyState.moveInterval = 5.0f + (rand() % 10);
+        foxyState.moveInterval = 5.0f + randomInt(10);
     }
 
     // update Bonnie
     bonnieState.moveTimer += deltaTime;
 
     if (bonnieState.moveTimer >= bonnieState.moveInterval) {
-        if (rand() % 100 < 50) {  // 50% chance
+        if (randomInt(100) < 50) {  // 50% chance
             bonnieState.isVisible = true;
 
             if (!bonnieArrivedSoundPlayed) {
@@ -481,58 +711,51 @@ void updateAnimatronics(float deltaTime) {
         }
 
         bonnieState.moveTimer = 0.0f;
-        bonnieState.moveInterval = 5.0f + (rand() % 10);
+        bonnieState.moveInterval = 5.0f + randomInt(10);
     }
 }
 
-void processMovement() {
+void processMovement(float deltaTime) {
+    PROFILE_ZONE("processMovement");
 
     if (isTransitioning) {
         return;
     }
 
 	if (pressedKeys[GLFW_KEY_W]) {
-		myCamera.move(gps::MOVE_FORWARD, cameraSpeed);
+		myCamera.move(gps::MOVE_FORWARD, cameraSpeed * deltaTime);
 		//update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         // compute normal matrix for teapot
         normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 
 	if (pressedKeys[GLFW_KEY_S]) {
-		myCamera.move(gps::MOVE_BACKWARD, cameraSpeed);
+		myCamera.move(gps::MOVE_BACKWARD, cameraSpeed * deltaTime);
         //update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         // compute normal matrix for teapot
         normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 
 	if (pressedKeys[GLFW_KEY_A]) {
-		myCamera.move(gps::MOVE_LEFT, cameraSpeed);
+		myCamera.move(gps::MOVE_LEFT, cameraSpeed * deltaTime);
         //update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         // compute normal matrix for teapot
         normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 
 	if (pressedKeys[GLFW_KEY_D]) {
-		myCamera.move(gps::MOVE_RIGHT, cameraSpeed);
+		myCamera.move(gps::MOVE_RIGHT, cameraSpeed * deltaTime);
         //update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         // compute normal matrix for teapot
         normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
 	}
 
     if (pressedKeys[GLFW_KEY_Q]) {
-        angle -= 1.0f;
+        angle -= modelTurnSpeed * deltaTime;
         // update model matrix for teapot
         model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
         // update normal matrix for teapot
@@ -540,7 +763,7 @@ void processMovement() {
     }
 
     if (pressedKeys[GLFW_KEY_E]) {
-        angle += 1.0f;
+        angle += modelTurnSpeed * deltaTime;
         // update model matrix for teapot
         model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
         // update normal matrix for teapot
@@ -548,18 +771,14 @@ void processMovement() {
     }
 
     if (pressedKeys[GLFW_KEY_SPACE]) {
-        myCamera.move(gps::MOVE_UP, cameraSpeed);
+        myCamera.move(gps::MOVE_UP, cameraSpeed * deltaTime);
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
     }
 
     if (pressedKeys[GLFW_KEY_LEFT_SHIFT]) {
-        myCamera.move(gps::MOVE_DOWN, cameraSpeed);
+        myCamera.move(gps::MOVE_DOWN, cameraSpeed * deltaTime);
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
     }
 
@@ -577,11 +796,21 @@ void processMovement() {
 }
 
 void initOpenGLWindow() {
-    myWindow.Create(1920, 1080, "OpenGL Project Core");
+    if (offscreen) {
+        myWindow.CreateOffscreen(1920, 1080);
+        return;
+    }
+
+    //benchmarks render into a hidden window
+    myWindow.Create(1920, 1080, "OpenGL Project Core", benchmarkFrames == 0 && goldenDir.empty());
     glfwSetInputMode(myWindow.getWindow(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 }
 
 void setWindowCallbacks() {
+    if (!myWindow.getWindow()) {
+        return;
+    }
+
 	glfwSetWindowSizeCallback(myWindow.getWindow(), windowResizeCallback);
     glfwSetKeyCallback(myWindow.getWindow(), keyboardCallback);
     glfwSetCursorPosCallback(myWindow.getWindow(), mouseCallback);
@@ -599,12 +828,42 @@ void initOpenGLState() {
 }
 
 void initModels() {
+    PROFILE_ZONE("initModels");
+    gps::Model3D* models[] = { &bathroom, &nightmareFoxy, &nightmareBonnie, &flashlight, &candles, &bathroomDoor };
+    for (gps::Model3D* model : models) {
+        if (!generateLods) {
+            model->lodLevels = 1;
+        }
+        model->packVertices = packedVertices;
+        model->releaseCpuData = releaseMeshData;
+    }
+
+    gps::AllocationStats before = gps::AllocationStats::current();
+
     bathroom.LoadModel("models/bathroom/bathroom1.obj");
     nightmareFoxy.LoadModel("models/nightmare_foxy/nightmare_foxy.obj");
     nightmareBonnie.LoadModel("models/nightmare_bonnie/nightmare_bonnie.obj");
     flashlight.LoadModel("models/flashlight/flashlight.obj");
     candles.LoadModel("models/candles/candles.obj");
     bathroomDoor.LoadModel("models/bathroom_door/bathroom_door.obj");
+
+    size_t cpuBytes = 0, gpuBytes = 0;
+    for (gps::Model3D* model : models) {
+        cpuBytes += model->GetCpuBytes();
+        gpuBytes += model->GetGpuBytes();
+    }
+    printf("Mesh memory: %.1f MB in RAM, %.1f MB in GL buffers%s\n",
+        cpuBytes / (1024.0 * 1024.0), gpuBytes / (1024.0 * 1024.0), releaseMeshData ? " (CPU copies released)" : "");
+
+    gps::AllocationStats after = gps::AllocationStats::current();
+    if (gps::AllocationStats::COUNTING) {
+        printf("Model loading: %zu heap allocations, %.1f MB allocated, peak RSS %.1f MB\n",
+            after.allocations - before.allocations, (after.bytes - before.bytes) / (1024.0 * 1024.0),
+            gps::AllocationStats::peakResidentBytes() / (1024.0 * 1024.0));
+    } else {
+        printf("Model loading: peak RSS %.1f MB (define GPS_ALLOCATION_STATS to count heap allocations)\n",
+            gps::AllocationStats::peakResidentBytes() / (1024.0 * 1024.0));
+    }
 }
 
 void initAudio() {
@@ -657,14 +916,219 @@ void initAudio() {
     backgroundMusic->play();
 }
 
-void initShaders() {
-	myBasicShader.loadShader(
+// defines every shader that reads gps::Mesh vertices needs
+std::vector<std::string> meshShaderDefines() {
+    std::vector<std::string> defines;
+    if (packedVertices) {
+        defines.push_back("PACKED_VERTICES");
+    }
+    return defines;
+}
+
+// points the FrameData and DrawData blocks of the program, where it has them, at their binding points
+void bindUniformBlocks(gps::Shader shader) {
+    GLuint frameIndex = glGetUniformBlockIndex(shader.shaderProgram, "FrameData");
+    if (frameIndex != GL_INVALID_INDEX) {
+        glUniformBlockBinding(shader.shaderProgram, frameIndex, FRAME_DATA_BINDING);
+    }
+
+    GLuint drawIndex = glGetUniformBlockIndex(shader.shaderProgram, "DrawData");
+    if (drawIndex != GL_INVALID_INDEX) {
+        glUniformBlockBinding(shader.shaderProgram, drawIndex, DRAW_DATA_BINDING);
+    }
+}
+
+// shadow layers of the candles that are lit; the ones past the last lit candle are left out of basic.frag
+int countShadowedCandles() {
+    int count = 0;
+    for (int i = 0; i < 3 && i < (int)pointLights.size(); i++) {
+        if (pointLights[i].enabled) {
+            count = i + 1;
+        }
+    }
+    return count;
+}
+
+// the per-frame part of the basic.vert/basic.frag permutation key; HAS_SPECULAR_MAP is picked per mesh by Model3D
+uint32_t basicFrameVariant() {
+    return myBasicShader.featureValue("FLASHLIGHT_ON", flashlightOn ? 1 : 0)
+        | myBasicShader.featureValue("NUM_SHADOWED_LIGHTS", countShadowedCandles());
+}
+
+// uniforms a variant of basic.frag needs before its first draw of the frame
+void setupBasicVariant(gps::Shader& shader, bool compiled) {
+    if (compiled) {
+        bindUniformBlocks(shader);
+    }
+
+    shader.useShaderProgram();
+    glUniform1i(shader.getUniformLocation("shadowMapArray"), 2);
+    glUniform1i(shader.getUniformLocation("shadowQuality"), shadowQuality);
+    glUniform1i(shader.getUniformLocation("lodTint"), lodTint);
+    lightClusters.bind(shader.shaderProgram);
+}
+
+// what setupBasicVariant() sent last; the variants are only set up again when one of these changes
+struct BasicVariantInputs {
+    int shadowQuality = -1;
+    bool lodTint = false;
+    unsigned int clusterBinding = 0;
+};
+BasicVariantInputs basicVariantInputs;
+
+void loadBasicShader() {
+    std::vector<std::string> defines = meshShaderDefines();
+    if (lightSpaceInFragment) {
+        defines.push_back("LIGHT_SPACE_IN_FRAGMENT");
+    }
+
+    //branches on state that holds for a whole mesh or frame are compiled out instead
+    std::vector<gps::ShaderFeature> features = {
+        { "HAS_SPECULAR_MAP", 1 },
+        { "FLASHLIGHT_ON", 1 },
+        { "NUM_SHADOWED_LIGHTS", 2 }
+    };
+
+    myBasicShader.loadPermutations(
         "shaders/basic.vert",
-        "shaders/basic.frag");
+        "shaders/basic.frag",
+        defines,
+        features,
+        setupBasicVariant);
+}
+
+// the programs submitted by beginShaders() and not finished yet
+std::vector<gps::Shader*> pendingShaders;
+int shadersDoneEarly = 0;
+
+// how the programs of this launch were built, the cache hits skip compiling and linking
+void printShaderStartup() {
+    const gps::ProgramCache::Stats& stats = gps::ProgramCache::getStats();
+    //compile time is what the main thread spent submitting and waiting, the rest overlapped model loading
+    if (gps::Shader::hasParallelCompile()) {
+        printf("Shader compiles: parallel (KHR_parallel_shader_compile), %d programs were done before the models finished loading\n",
+            shadersDoneEarly);
+    }
+    if (!gps::ProgramCache::isEnabled()) {
+        printf("Shaders: %d compiled in %.1f ms (program cache off)\n", stats.compiled, stats.compileMs);
+        return;
+    }
+    printf("Shaders: %d loaded from cache in %.1f ms, %d compiled in %.1f ms",
+        stats.hits, stats.loadMs, stats.compiled, stats.compileMs);
+    if (stats.rejected > 0) {
+        printf(" (%d cached binaries rejected by the driver)", stats.rejected);
+    }
+    printf("\n");
+}
+
+// submits every program without waiting on the driver, the models load while it compiles
+void beginShaders() {
+    PROFILE_ZONE("beginShaders");
+    loadBasicShader();
+    //the flashlight goes on and off and meshes come with and without specular maps; candle shadows as lit now
+    for (int flashlight = 0; flashlight < 2; flashlight++) {
+        for (int specular = 0; specular < 2; specular++) {
+            myBasicShader.prepareVariant(myBasicShader.featureValue("HAS_SPECULAR_MAP", specular)
+                | myBasicShader.featureValue("FLASHLIGHT_ON", flashlight)
+                | myBasicShader.featureValue("NUM_SHADOWED_LIGHTS", countShadowedCandles()));
+        }
+    }
 
-    depthMapShader.loadShader(
+    depthMapShader.beginLoad(
         "shaders/depthMap.vert",
-        "shaders/depthMap.frag");
+        "shaders/depthMap.frag",
+        meshShaderDefines());
+    pendingShaders.push_back(&depthMapShader);
+
+    //depth only, the empty depthMap.frag is enough
+    depthPrepassShader.beginLoad(
+        "shaders/depthPrepass.vert",
+        "shaders/depthMap.frag",
+        meshShaderDefines());
+    pendingShaders.push_back(&depthPrepassShader);
+
+    if (deferredShading) {
+        //only the G-buffer outputs are needed, skip the per vertex light-space projections
+        std::vector<std::string> gBufferDefines = meshShaderDefines();
+        gBufferDefines.push_back("LIGHT_SPACE_IN_FRAGMENT");
+
+        gBufferShader.beginLoad(
+            "shaders/basic.vert",
+            "shaders/gbuffer.frag",
+            gBufferDefines);
+
+        deferredLightShader.beginLoad(
+            "shaders/deferredLight.vert",
+            "shaders/deferredLight.frag",
+            std::vector<std::string>());
+
+        deferredPointShader.beginLoad(
+            "shaders/deferredPoint.vert",
+            "shaders/deferredPoint.frag",
+            std::vector<std::string>());
+
+        pendingShaders.push_back(&gBufferShader);
+        pendingShaders.push_back(&deferredLightShader);
+        pendingShaders.push_back(&deferredPointShader);
+    }
+}
+
+// finishes the programs the driver is already done with; with finishAll the rest are waited for
+void finishShaders(bool finishAll) {
+    PROFILE_ZONE("finishShaders");
+    for (size_t i = 0; i < pendingShaders.size();) {
+        if (!finishAll && !pendingShaders[i]->isLoadComplete()) {
+            i++;
+            continue;
+        }
+
+        pendingShaders[i]->finishLoad();
+        bindUniformBlocks(*pendingShaders[i]);
+        if (!finishAll) {
+            shadersDoneEarly++;
+        }
+        pendingShaders.erase(pendingShaders.begin() + i);
+    }
+}
+
+// the programs the hot reload rebuilds
+std::vector<gps::Shader*> reloadableShaders() {
+    std::vector<gps::Shader*> shaders = { &myBasicShader, &depthMapShader, &depthPrepassShader };
+    if (deferredShading) {
+        shaders.push_back(&gBufferShader);
+        shaders.push_back(&deferredLightShader);
+        shaders.push_back(&deferredPointShader);
+    }
+    return shaders;
+}
+
+// starts rebuilding the programs that use a changed file and swaps in the ones that finished
+void updateShaderReload() {
+    PROFILE_ZONE("updateShaderReload");
+    if (!hotReload) {
+        return;
+    }
+
+    std::vector<gps::Shader*> shaders = reloadableShaders();
+    std::vector<std::string> changed = shaderWatcher.poll();
+
+    for (gps::Shader* shader : shaders) {
+        for (const std::string& file : changed) {
+            if (shader->dependsOn(file)) {
+                std::cout << "Shader source changed: " << file << std::endl;
+                shader->beginReload();
+                break;
+            }
+        }
+    }
+
+    //uniforms are looked up where they are set, so only the block bindings need redoing;
+    //the forward variants redo theirs in setupBasicVariant()
+    for (gps::Shader* shader : shaders) {
+        if (shader->updateReload() && shader != &myBasicShader) {
+            bindUniformBlocks(*shader);
+        }
+    }
 }
 
 void initCandleLights() {
@@ -694,6 +1158,11 @@ void initCandleLights() {
     } 
 }
 
+void initPortals() {
+    portalGraph.load("models/bathroom/bathroom.cells");
+    doorPortal = portalGraph.findPortal("door");
+}
+
 void initCameraStates() {
     cameraStates.clear();
 
@@ -729,8 +1198,11 @@ void initShadowFBO() {
     glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT,
         SHADOW_WIDTH, SHADOW_HEIGHT, SHADOW_LAYERS, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    // linear filtering + compare mode gives bilinear hardware PCF per tap
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
     float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
@@ -742,7 +1214,7 @@ void initShadowFBO() {
     glDrawBuffer(GL_NONE);
     glReadBuffer(GL_NONE);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, myWindow.getFramebuffer());
 }
 
 glm::mat4 computeLightSpaceMatrix() {
@@ -758,109 +1230,46 @@ glm::mat4 computeLightSpaceMatrix() {
 }
 
 void initUniforms() {
-	myBasicShader.useShaderProgram();
-
     // create model matrix for teapot
     model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-	modelLoc = glGetUniformLocation(myBasicShader.shaderProgram, "model");
 
 	// get view matrix for current camera
 	view = myCamera.getViewMatrix();
-	viewLoc = glGetUniformLocation(myBasicShader.shaderProgram, "view");
-	// send view matrix to shader
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 
     // compute normal matrix for teapot
     normalMatrix = glm::mat3(glm::inverseTranspose(view*model));
-	normalMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "normalMatrix");
 
 	// create projection matrix
 	projection = glm::perspective(glm::radians(45.0f),
                                (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
                                0.1f, 20.0f);
-	projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-	// send projection matrix to shader
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));	
 
 	//set the light direction (direction towards the light)
 	lightDir = glm::vec3(0.0f, 0.0f, 0.0f);
-	lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDir");
-	// send light dir to shader
-	glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
 
 	//set light color
 	lightColor = glm::vec3(0.25f, 0.0f, 0.0f);
-	lightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightColor");
-	// send light color to shader
-	glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
 
     // Initialize spotlight (flashlight)
     spotLightColor = glm::vec3(1.0f, 0.95f, 0.85f); // Slightly warm white for flashlight effect
-    spotLightPosLoc = glGetUniformLocation(myBasicShader.shaderProgram, "spotLightPos");
-    spotLightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "spotLightDir");
-    spotLightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "spotLightColor");
-    spotLightCutOffLoc = glGetUniformLocation(myBasicShader.shaderProgram, "spotLightCutOff");
-    spotLightOuterCutOffLoc = glGetUniformLocation(myBasicShader.shaderProgram, "spotLightOuterCutOff");
-    spotLightConstantLoc = glGetUniformLocation(myBasicShader.shaderProgram, "spotLightConstant");
-    spotLightLinearLoc = glGetUniformLocation(myBasicShader.shaderProgram, "spotLightLinear");
-    spotLightQuadraticLoc = glGetUniformLocation(myBasicShader.shaderProgram, "spotLightQuadratic");
-
-    // Set spotlight parameters
-    glUniform1f(spotLightCutOffLoc, glm::cos(glm::radians(10.0f)));      // Inner cone angle
-    glUniform1f(spotLightOuterCutOffLoc, glm::cos(glm::radians(12.0f))); // Outer cone angle for smooth edges
-    glUniform1f(spotLightConstantLoc, 1.0f);      // Constant attenuation
-    glUniform1f(spotLightLinearLoc, 0.45f);       // Linear attenuation
-    glUniform1f(spotLightQuadraticLoc, 0.75f);   // Quadratic attenuation
-
-    lightSpaceMatrix = computeLightSpaceMatrix();
-    lightSpaceMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightSpaceMatrix");
-    glUniformMatrix4fv(lightSpaceMatrixLoc, 1, GL_FALSE, glm::value_ptr(lightSpaceMatrix));
-
-    //Set point light - candles
-    numPointLightsLoc = glGetUniformLocation(myBasicShader.shaderProgram, "numPointLights");
 
-    // Get uniform locations for each point light
-    for (int i = 0; i < MAX_POINT_LIGHTS; i++) {
-        std::string baseName = "pointLights[" + std::to_string(i) + "]";
+    // matrices, light and flashlight state reach the shaders through FrameData, see uploadFrameData()
 
-        pointLightPosLoc[i] = glGetUniformLocation(myBasicShader.shaderProgram,
-            (baseName + ".position").c_str());
-        pointLightColorLoc[i] = glGetUniformLocation(myBasicShader.shaderProgram,
-            (baseName + ".color").c_str());
-        pointLightConstantLoc[i] = glGetUniformLocation(myBasicShader.shaderProgram,
-            (baseName + ".constant").c_str());
-        pointLightLinearLoc[i] = glGetUniformLocation(myBasicShader.shaderProgram,
-            (baseName + ".linear").c_str());
-        pointLightQuadraticLoc[i] = glGetUniformLocation(myBasicShader.shaderProgram,
-            (baseName + ".quadratic").c_str());
-    }
+    lightSpaceMatrix = computeLightSpaceMatrix();
 
-    // Set shadow map texture unit
-    shadowMapLoc = glGetUniformLocation(myBasicShader.shaderProgram, "shadowMap");
-    glUniform1i(shadowMapLoc, 2);
+    //point lights - candles, the cluster grid follows the projection
+    lightClusters.setProjection(projection,
+        myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height,
+        0.1f, 20.0f);
 
+    // shadow map unit and quality are sent per variant of basic.frag, see setupBasicVariant()
 }
 
-void renderBathroom(gps::Shader shader) {
-     // select active shader program
-    shader.useShaderProgram();
-
-    glm::mat4 bathroomModel = glm::mat4(1.0f);
-
-    //send model matrix data to shader
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(bathroomModel));
-
-    //send normal matrix data to shader
-    glm::mat3 bathroomNormal = glm::mat3(glm::inverseTranspose(view * bathroomModel));
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(bathroomNormal));
-
-    // draw bathroom
-    bathroom.Draw(shader);
+glm::mat4 computeBathroomModel() {
+    return glm::mat4(1.0f);
 }
 
-void renderFoxy(gps::Shader shader) {
-    shader.useShaderProgram();
-
+glm::mat4 computeFoxyModel() {
     glm::mat4 foxyModel = glm::mat4(1.0f);
    
     foxyModel = glm::translate(foxyModel, foxyState.getCurrentPosition());
@@ -875,17 +1284,10 @@ void renderFoxy(gps::Shader shader) {
 
     foxyModel = glm::scale(foxyModel, glm::vec3(1.25f, 1.25f, 1.25f));
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(foxyModel));
-
-    glm::mat3 foxyNormal = glm::mat3(glm::inverseTranspose(view * foxyModel));
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(foxyNormal));
-
-    nightmareFoxy.Draw(shader);
+    return foxyModel;
 }
 
-void renderBonnie(gps::Shader shader) {
-    shader.useShaderProgram();
-
+glm::mat4 computeBonnieModel() {
     glm::mat4 bonnieModel = glm::mat4(1.0f);
     bonnieModel = glm::translate(bonnieModel,bonnieState.getCurrentPosition());
 
@@ -897,19 +1299,10 @@ void renderBonnie(gps::Shader shader) {
 
     bonnieModel = glm::scale(bonnieModel, glm::vec3(1.25f, 1.25f, 1.25f));
 
-    //send teapot model matrix data to shader
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(bonnieModel));
-
-    glm::mat3 bonnieNormal = glm::mat3(glm::inverseTranspose(view * bonnieModel));
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(bonnieNormal));
-
-    // draw teapot
-    nightmareBonnie.Draw(shader);
+    return bonnieModel;
 }
 
-void renderFlashlight(gps::Shader shader) {
-    shader.useShaderProgram();
-
+glm::mat4 computeFlashlightModel() {
     glm::mat4 flashlightModel = glm::mat4(1.0f);
 
     glm::vec3 camPos = myCamera.getCameraPosition();
@@ -934,54 +1327,308 @@ void renderFlashlight(gps::Shader shader) {
     flashlightModel = glm::rotate(flashlightModel, glm::radians(120.4f), glm::vec3(0.0f, 1.0f, 0.0f));
     flashlightModel = glm::scale(flashlightModel, glm::vec3(4.0f, 4.0f, 4.0f));
 
-    //send model matrix data to shader
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(flashlightModel));
+    return flashlightModel;
+}
 
-    //send normal matrix data to shader
-    glm::mat3 flashlightNormal = glm::mat3(glm::inverseTranspose(view * flashlightModel));
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(flashlightNormal));
+glm::mat4 computeCandlesModel() {
+    return glm::translate(glm::mat4(1.0f), glm::vec3(0.7f, 0.85f, 0.471f));
+}
 
-    // draw flashlight
-    flashlight.Draw(shader);
+// lays count candles out on a square grid spanning the bathroom floor
+void placeStressCandles(int count) {
+    stressCandleModels.clear();
+    if (count <= 0) return;
+
+    gps::Bounds room = bathroom.GetBounds();
+    glm::mat4 bathroomModel = computeBathroomModel();
+    glm::vec3 roomMin = glm::vec3(bathroomModel * glm::vec4(room.min, 1.0f));
+    glm::vec3 roomMax = glm::vec3(bathroomModel * glm::vec4(room.max, 1.0f));
+    glm::vec3 floorMin = glm::min(roomMin, roomMax);
+    glm::vec3 floorMax = glm::max(roomMin, roomMax);
+
+    int side = (int)std::ceil(std::sqrt((float)count));
+    glm::vec2 spacing = glm::vec2(floorMax.x - floorMin.x, floorMax.z - floorMin.z) / (float)side;
+
+    stressCandleModels.reserve(count);
+    for (int i = 0; i < count; i++) {
+        //bottom of the candles on the floor, each turned a little so the copies don't line up
+        glm::vec3 position(floorMin.x + ((i % side) + 0.5f) * spacing.x,
+            floorMin.y - candleBounds.min.y,
+            floorMin.z + ((i / side) + 0.5f) * spacing.y);
+        glm::mat4 candleModel = glm::translate(glm::mat4(1.0f), position);
+        stressCandleModels.push_back(glm::rotate(candleModel, glm::radians(37.0f * i), glm::vec3(0.0f, 1.0f, 0.0f)));
+    }
 }
 
-void renderCandles(gps::Shader shader) {
+void initStressCandles() {
+    PROFILE_ZONE("initStressCandles");
+    if (stressCandles <= 0) return;
+
+    candleInstances.init();
+    candleBounds = candles.GetBounds();
+    placeStressCandles(stressCandles);
+    printf("Stress scene: %d candle instances\n", stressCandles);
+}
+
+glm::mat4 computeBathroomDoorModel() {
+    glm::mat4 doorModel = glm::mat4(1.0f);
+
+    doorModel = glm::translate(doorModel, glm::vec3(-0.1495f, 0.0479f, 0.86624f));
+
+    doorModel = glm::rotate(doorModel, glm::radians(doorAngle), glm::vec3(0.0f, 1.0f, 0.0f));
+    doorModel = glm::scale(doorModel, glm::vec3(0.91f, 0.91f, 0.91f));
+
+    return doorModel;
+}
+
+// fills meshVisible for the camera: view frustum narrowed through the portals, then the Hi-Z test
+// returns the number of visible meshes, occluded gets the number rejected by the Hi-Z test
+int cullForCamera(const gps::Model3D& object, const glm::mat4& modelMatrix, int& occluded) {
+    int visibleCount = portalGraph.cullSpheres(object.GetMeshSpheres(), modelMatrix, projection * view, cameraCells, meshVisible);
+
+    occluded = 0;
+    if (occlusionCulling && hiZBuffer.isValid()) {
+        for (int i = 0; i < object.GetMeshCount(); i++) {
+            if (meshVisible[i] && hiZBuffer.isOccluded(object.GetMeshBounds(i).min, object.GetMeshBounds(i).max, modelMatrix)) {
+                meshVisible[i] = 0;
+                occluded++;
+            }
+        }
+    }
+
+    return visibleCount - occluded;
+}
+
+// fills meshletRanges for the meshes selected in meshVisible/meshLods, as seen through clipMatrix
+void selectMeshlets(gps::Model3D& object, const glm::mat4& clipMatrix, bool countStats) {
+    if (!meshletCulling) {
+        meshletRanges.clear();
+        return;
+    }
+
+    int tested;
+    int culled = object.CullMeshlets(clipMatrix, meshVisible, meshLods, meshletRanges, tested);
+    if (countStats) {
+        meshletsCulled += culled;
+        meshletsTotal += tested;
+    }
+}
+
+// fills the FrameData block for this frame and binds it for every program
+void uploadFrameData() {
+    FrameData frame;
+    frame.view = view;
+    frame.projection = projection;
+    frame.inverseView = glm::inverse(view);
+    for (int i = 0; i < SHADOW_LAYERS; i++) {
+        frame.lightSpaceMatrices[i] = lightMatrices[i];
+    }
+    frame.lightDir = lightDir;
+    frame.lightColor = lightColor;
+    frame.spotLightPos = spotLightPos;
+    frame.spotLightDir = spotLightDir;
+    frame.spotLightColor = currentFlashlightColor;
+    frame.spotLightCutOff = glm::cos(glm::radians(spotLightCutOffAngle));
+    frame.spotLightOuterCutOff = glm::cos(glm::radians(spotLightOuterCutOffAngle));
+    frame.spotLightConstant = spotLightConstant;
+    frame.spotLightLinear = spotLightLinear;
+    frame.spotLightQuadratic = spotLightQuadratic;
+
+    //stays bound for every draw of the frame, so a ring overflow must not reuse it
+    GLintptr offset = uniformRing.writeForFrame(&frame, sizeof(frame));
+    uniformRing.bindRange(FRAME_DATA_BINDING, offset, sizeof(frame));
+}
+
+// model and normal matrix of the next draw
+void uploadDrawData(const glm::mat4& modelMatrix) {
+    DrawData draw;
+    draw.model = modelMatrix;
+    glm::mat3 normal = glm::mat3(glm::inverseTranspose(view * modelMatrix));
+    for (int i = 0; i < 3; i++) {
+        draw.normalMatrix[i] = glm::vec4(normal[i], 0.0f);
+    }
+
+    GLintptr offset = uniformRing.write(&draw, sizeof(draw));
+    uniformRing.bindRange(DRAW_DATA_BINDING, offset, sizeof(draw));
+}
+
+// culls the stress candles against clipMatrix (the camera's or a shadow layer's) and draws the survivors,
+// all at the level of detail the nearest one calls for
+void drawCandleInstances(gps::Shader shader, const glm::mat4& clipMatrix, float viewportHeight, float maxPixelError, bool depthOnly) {
+    if (stressCandleModels.empty()) return;
+
+    gps::Frustum frustum;
+    frustum.extract(clipMatrix);
+
+    visibleCandleModels.clear();
+    glm::mat4 nearestModel;
+    float nearestDepth = 0.0f;
+
+    for (size_t i = 0; i < stressCandleModels.size(); i++) {
+        glm::vec4 center = stressCandleModels[i] * glm::vec4(candleBounds.center, 1.0f);
+        if (frustumCulling && !frustum.intersectsSphere(glm::vec3(center), candleBounds.radius)) continue;
+
+        //clip w grows with the distance from a perspective eye, and is the same for every copy under an orthographic one
+        float depth = (clipMatrix * center).w;
+        if (visibleCandleModels.empty() || depth < nearestDepth) {
+            nearestModel = stressCandleModels[i];
+            nearestDepth = depth;
+        }
+        visibleCandleModels.push_back(stressCandleModels[i]);
+    }
+
+    if (!depthOnly) {
+        candleInstancesDrawn += (int)visibleCandleModels.size();
+    }
+    if (visibleCandleModels.empty()) return;
+
+    candles.SelectLods(clipMatrix * nearestModel, viewportHeight, maxPixelError, meshLods);
+
+    if (instanceCandles) {
+        candleInstances.upload(visibleCandleModels);
+        if (depthOnly) {
+            candles.DrawDepthInstanced(shader, candleInstances, meshLods);
+        } else {
+            candles.DrawInstanced(shader, candleInstances, meshLods);
+        }
+        return;
+    }
+
+    //one draw per copy and mesh, each with its own DrawData
+    meshVisible.assign(candles.GetMeshCount(), 1);
+    meshletRanges.clear();
+    for (size_t i = 0; i < visibleCandleModels.size(); i++) {
+        uploadDrawData(visibleCandleModels[i]);
+        if (depthOnly) {
+            candles.DrawDepth(shader, meshVisible, meshLods, meshletRanges);
+        } else {
+            candles.Draw(shader, meshVisible, meshLods, meshletRanges);
+        }
+    }
+}
+
+// draws the meshes of the model that the camera can see, each at the level of detail its size on screen calls for
+void drawModel(gps::Model3D& object, gps::Shader shader, const glm::mat4& modelMatrix) {
+    meshesTotal += object.GetMeshCount();
+
+    if (frustumCulling) {
+        int occluded;
+        int visibleCount = cullForCamera(object, modelMatrix, occluded);
+        meshesCulled += object.GetMeshCount() - visibleCount;
+        meshesOccluded += occluded;
+    } else {
+        meshVisible.assign(object.GetMeshCount(), 1);
+    }
+
+    glm::mat4 clipMatrix = projection * view * modelMatrix;
+    object.SelectLods(clipMatrix, (float)myWindow.getWindowDimensions().height, lodPixelError, meshLods);
+    selectMeshlets(object, clipMatrix, true);
+    object.Draw(shader, meshVisible, meshLods, meshletRanges);
+}
+
+// same selection as drawModel(), so the color pass finds the pre-pass depth it expects
+void drawModelDepth(gps::Model3D& object, gps::Shader shader, const glm::mat4& modelMatrix) {
+    if (frustumCulling) {
+        int occluded;
+        cullForCamera(object, modelMatrix, occluded);
+    } else {
+        meshVisible.assign(object.GetMeshCount(), 1);
+    }
+
+    glm::mat4 clipMatrix = projection * view * modelMatrix;
+    object.SelectLods(clipMatrix, (float)myWindow.getWindowDimensions().height, lodPixelError, meshLods);
+    selectMeshlets(object, clipMatrix, false);
+    object.DrawDepth(shader, meshVisible, meshLods, meshletRanges);
+}
+
+// same culling from the viewpoint of the shadow layer being rendered, with the looser shadow lod budget
+void drawShadowCaster(gps::Model3D& object, gps::Shader shader, const glm::mat4& modelMatrix) {
+    shadowMeshesTotal += object.GetMeshCount();
+
+    if (frustumCulling) {
+        int visibleCount = portalGraph.cullSpheres(object.GetMeshSpheres(), modelMatrix, shadowCasterMatrix, shadowCasterCells, meshVisible);
+        shadowMeshesCulled += object.GetMeshCount() - visibleCount;
+    } else {
+        meshVisible.assign(object.GetMeshCount(), 1);
+    }
+
+    glm::mat4 clipMatrix = shadowCasterMatrix * modelMatrix;
+    object.SelectLods(clipMatrix, (float)SHADOW_HEIGHT, shadowLodPixelError, meshLods);
+    selectMeshlets(object, clipMatrix, true);
+    object.DrawDepth(shader, meshVisible, meshLods, meshletRanges);
+}
+
+void renderBathroom(gps::Shader shader) {
+     // select active shader program
     shader.useShaderProgram();
 
-    glm::mat4 candlesModel = glm::mat4(1.0f);
-    candlesModel = glm::translate(candlesModel, glm::vec3(0.7f, 0.85f, 0.471f));
+    glm::mat4 bathroomModel = computeBathroomModel();
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(candlesModel));
+    uploadDrawData(bathroomModel);
 
-    glm::mat3 candlesNormal = glm::mat3(glm::inverseTranspose(view * candlesModel));
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(candlesNormal));
+    // draw bathroom
+    drawModel(bathroom, shader, bathroomModel);
+}
 
-    candles.Draw(shader);
+void renderFoxy(gps::Shader shader) {
+    shader.useShaderProgram();
+
+    glm::mat4 foxyModel = computeFoxyModel();
+
+    uploadDrawData(foxyModel);
+
+    drawModel(nightmareFoxy, shader, foxyModel);
 }
 
-void renderBathroomDoor(gps::Shader shader) {
+void renderBonnie(gps::Shader shader) {
     shader.useShaderProgram();
 
-    glm::mat4 doorModel = glm::mat4(1.0f);
+    glm::mat4 bonnieModel = computeBonnieModel();
 
-    doorModel = glm::translate(doorModel, glm::vec3(-0.1495f, 0.0479f, 0.86624f));
+    uploadDrawData(bonnieModel);
 
-    doorModel = glm::rotate(doorModel, glm::radians(doorAngle), glm::vec3(0.0f, 1.0f, 0.0f));
-    doorModel = glm::scale(doorModel, glm::vec3(0.91f, 0.91f, 0.91f));
+    // draw teapot
+    drawModel(nightmareBonnie, shader, bonnieModel);
+}
+
+void renderFlashlight(gps::Shader shader) {
+    shader.useShaderProgram();
 
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(doorModel));
+    glm::mat4 flashlightModel = computeFlashlightModel();
 
-    glm::mat3 doorNormal = glm::mat3(glm::inverseTranspose(view * doorModel));
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(doorNormal));
+    uploadDrawData(flashlightModel);
 
-    bathroomDoor.Draw(shader);
+    // draw flashlight
+    drawModel(flashlight, shader, flashlightModel);
+}
+
+void renderCandles(gps::Shader shader) {
+    shader.useShaderProgram();
+
+    glm::mat4 candlesModel = computeCandlesModel();
+
+    uploadDrawData(candlesModel);
+
+    drawModel(candles, shader, candlesModel);
+
+    drawCandleInstances(shader, projection * view, (float)myWindow.getWindowDimensions().height, lodPixelError, false);
+}
+
+void renderBathroomDoor(gps::Shader shader) {
+    shader.useShaderProgram();
+
+    glm::mat4 doorModel = computeBathroomDoorModel();
+
+    uploadDrawData(doorModel);
+
+    drawModel(bathroomDoor, shader, doorModel);
 }
 
 void renderBathroomDepth(gps::Shader shader) {
     shader.useShaderProgram();
     glm::mat4 bathroomModel = glm::mat4(1.0f);
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(bathroomModel));
-    bathroom.Draw(shader);
+    uploadDrawData(bathroomModel);
+    drawShadowCaster(bathroom, shader, bathroomModel);
 }
 
 void renderFoxyDepth(gps::Shader shader) {
@@ -992,8 +1639,8 @@ void renderFoxyDepth(gps::Shader shader) {
     foxyModel = glm::rotate(foxyModel, glm::radians(5.5f), glm::vec3(1.0f, 0.0f, 0.0f));
     foxyModel = glm::rotate(foxyModel, glm::radians(-98.4f), glm::vec3(0.0f, 1.0f, 0.0f));
     foxyModel = glm::scale(foxyModel, glm::vec3(1.25f, 1.25f, 1.25f));
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(foxyModel));
-    nightmareFoxy.Draw(shader);
+    uploadDrawData(foxyModel);
+    drawShadowCaster(nightmareFoxy, shader, foxyModel);
 }
 
 void renderBonnieDepth(gps::Shader shader) {
@@ -1002,16 +1649,18 @@ void renderBonnieDepth(gps::Shader shader) {
     bonnieModel = glm::translate(bonnieModel, bonnieState.getCurrentPosition());
     bonnieModel = glm::rotate(bonnieModel, glm::radians(-80.4f), glm::vec3(0.0f, 1.0f, 0.0f));
     bonnieModel = glm::scale(bonnieModel, glm::vec3(1.25f, 1.25f, 1.25f));
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(bonnieModel));
-    nightmareBonnie.Draw(shader);
+    uploadDrawData(bonnieModel);
+    drawShadowCaster(nightmareBonnie, shader, bonnieModel);
 }
 
 void renderCandlesDepth(gps::Shader shader) {
     shader.useShaderProgram();
     glm::mat4 candlesModel = glm::mat4(1.0f);
     candlesModel = glm::translate(candlesModel, glm::vec3(0.7f, 0.85f, 0.471f));
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(candlesModel));
-    candles.Draw(shader);
+    uploadDrawData(candlesModel);
+    drawShadowCaster(candles, shader, candlesModel);
+
+    drawCandleInstances(shader, shadowCasterMatrix, (float)SHADOW_HEIGHT, shadowLodPixelError, true);
 }
 
 void renderBathroomDoorDepth(gps::Shader shader) {
@@ -1022,14 +1671,15 @@ void renderBathroomDoorDepth(gps::Shader shader) {
     doorModel = glm::rotate(doorModel, glm::radians(doorAngle), glm::vec3(0.0f, 1.0f, 0.0f));
     doorModel = glm::rotate(doorModel, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(doorModel));
-    bathroomDoor.Draw(shader);
+    uploadDrawData(doorModel);
+    drawShadowCaster(bathroomDoor, shader, doorModel);
 }
 
 void renderSceneDepth(gps::Shader shader, glm::mat4 currentLightSpaceMatrix) {
     shader.useShaderProgram();
+    shadowCasterMatrix = currentLightSpaceMatrix;
 
-    glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "lightSpaceMatrix"),
+    glUniformMatrix4fv(shader.getUniformLocation("lightSpaceMatrix"),
         1, GL_FALSE, glm::value_ptr(currentLightSpaceMatrix));
 
     renderBathroomDepth(shader);
@@ -1041,8 +1691,6 @@ void renderSceneDepth(gps::Shader shader, glm::mat4 currentLightSpaceMatrix) {
 }
 
 void updateFlashlight() {
-    myBasicShader.useShaderProgram();
-
     if (flashlightOn) {
         glm::vec3 camPos = myCamera.getCameraPosition();
         glm::vec3 camFront = myCamera.getCameraFrontDirection();
@@ -1056,56 +1704,56 @@ void updateFlashlight() {
 
         spotLightDir = camFront;
 
-        glUniform3fv(spotLightPosLoc, 1, glm::value_ptr(spotLightPos));
-        glUniform3fv(spotLightDirLoc, 1, glm::value_ptr(spotLightDir));
-
-        float time = glfwGetTime();
+        float time = (float)sceneTime;
         float flickerIntensity = 1.0f;
         float maxIrritation = glm::max(foxyState.lightIrritation, bonnieState.lightIrritation);
         float irritationPercent = maxIrritation / 3.0f;
 
         if (irritationPercent > 0.5f) {
             float sineFlicker = 0.85f + 0.15f * glm::sin(time * 50.0f);
-            float randomStutter = (rand() % 100 > (98 - (irritationPercent * 10))) ? 0.0f : 1.0f;
+            float randomStutter = (randomInt(100) > (98 - (irritationPercent * 10))) ? 0.0f : 1.0f;
 
             flickerIntensity = sineFlicker * randomStutter;
         }
 
-        glm::vec3 currentFlashlightColor = spotLightColor * flickerIntensity;
-        glUniform3fv(spotLightColorLoc, 1, glm::value_ptr(currentFlashlightColor));
+        currentFlashlightColor = spotLightColor * flickerIntensity;
 
     } else {
-        glUniform3fv(spotLightColorLoc, 1, glm::value_ptr(glm::vec3(0.0f)));
+        currentFlashlightColor = glm::vec3(0.0f);
     }
 }
 
 void updateCandleLights() {
-    myBasicShader.useShaderProgram();
-
     int numLights = std::min((int)pointLights.size(), MAX_POINT_LIGHTS);
-    glUniform1i(numPointLightsLoc, numLights);
+    clusterLights.resize(numLights);
 
     for (int i = 0; i < numLights; i++) {
-        glUniform3fv(pointLightPosLoc[i], 1, glm::value_ptr(pointLights[i].position));
-        glUniform3fv(pointLightColorLoc[i], 1, glm::value_ptr(pointLights[i].color));
-        glUniform1f(pointLightConstantLoc[i], pointLights[i].constant);
-        glUniform1f(pointLightLinearLoc[i], pointLights[i].linear);
-        glUniform1f(pointLightQuadraticLoc[i], pointLights[i].quadratic);
+        clusterLights[i].position = pointLights[i].position;
+        clusterLights[i].color = pointLights[i].color;
+        clusterLights[i].constant = pointLights[i].constant;
+        clusterLights[i].linear = pointLights[i].linear;
+        clusterLights[i].quadratic = pointLights[i].quadratic;
+        // the three candles own shadow layers 2-4, rendered only while they are lit
+        clusterLights[i].shadowLayer = (i < 3 && pointLights[i].enabled) ? i + 2 : -1;
     }
+
+    lightClusters.update(clusterLights, view);
 }
 
 void updateCandleFlicker(float deltaTime) {
+    PROFILE_ZONE("updateCandleFlicker");
     for (int i = 0; i < 3; i++) {
         if (i >= pointLights.size()) break;
         if (!pointLights[i].enabled) continue;
 
-        float flicker = 0.85f + (rand() % 100) / 100.0f * 0.3f;
+        float flicker = 0.85f + randomInt(100) / 100.0f * 0.3f;
         glm::vec3 baseColor = glm::vec3(1.0f, 0.6f, 0.3f);
         pointLights[i].color = baseColor * flicker;
     }
 }
 
 void updateDoorAnimation(float deltaTime) {
+    PROFILE_ZONE("updateDoorAnimation");
     float targetAngle = foxyState.isVisible ? -42.7f : 0.0f;
 
     if (foxyState.isVisible) {
@@ -1120,9 +1768,12 @@ void updateDoorAnimation(float deltaTime) {
     }else if (doorAngle > targetAngle) {
         doorAngle = glm::max(doorAngle - speed * deltaTime, targetAngle);
     }
+
+    //the shut door blocks the view into the hallway
+    portalGraph.setPortalOpen(doorPortal, doorAngle != 0.0f);
 }
 
-void renderScene() {
+void computeLightMatrices() {
 
     //moonlight light matrix
     lightMatrices[0] = computeLightSpaceMatrix();
@@ -1158,58 +1809,847 @@ void renderScene() {
             pointLights[i].position + lookDir,
             vectorDir);
     }
-    
+}
+
+// profiler scope names, one per shadow layer
+const char* const SHADOW_LAYER_NAMES[SHADOW_LAYERS] = { "moon", "flashlight shadow", "candle 1 shadow", "candle 2 shadow", "candle 3 shadow" };
+
+void renderShadowMaps() {
+    PROFILE_ZONE("renderShadowMaps");
     depthMapShader.useShaderProgram();
     glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
     glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
 
     for (int i = 0; i < SHADOW_LAYERS; i++) {
+        //layers no shader samples this frame keep their old contents
+        if ((i == 1 && !flashlightOn) || (i >= 2 && !pointLights[i - 2].enabled)) {
+            continue;
+        }
+
         glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthMapTextureArray, 0, i);
         glClear(GL_DEPTH_BUFFER_BIT);
 
-        glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceMatrix"),
+        //casters must be visible from the light through the portals; the moon's orthographic view has no eye to flood from
+        if (portalCulling && i > 0) {
+            glm::vec3 eye = (i == 1) ? myCamera.getCameraPosition() : pointLights[i - 2].position;
+            portalGraph.computeVisibility(eye, lightMatrices[i], shadowCasterCells);
+        } else {
+            shadowCasterCells.valid = false;
+        }
+
+        glUniformMatrix4fv(depthMapShader.getUniformLocation("lightSpaceMatrix"),
             1, GL_FALSE, glm::value_ptr(lightMatrices[i]));
+        gpuProfiler.beginScope(SHADOW_LAYER_NAMES[i]);
         renderSceneDepth(depthMapShader, lightMatrices[i]);
+        gpuProfiler.endScope();
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, myWindow.getFramebuffer());
+}
+
+void renderDepthPrepass() {
+    PROFILE_ZONE("renderDepthPrepass");
+    depthPrepassShader.useShaderProgram();
+
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+    //roughly front to back: the flashlight is in the camera's hand, the bathroom encloses everything
+    glm::mat4 flashlightModel = computeFlashlightModel();
+    uploadDrawData(flashlightModel);
+    drawModelDepth(flashlight, depthPrepassShader, flashlightModel);
+
+    glm::mat4 foxyModel = computeFoxyModel();
+    uploadDrawData(foxyModel);
+    drawModelDepth(nightmareFoxy, depthPrepassShader, foxyModel);
+
+    glm::mat4 bonnieModel = computeBonnieModel();
+    uploadDrawData(bonnieModel);
+    drawModelDepth(nightmareBonnie, depthPrepassShader, bonnieModel);
 
+    glm::mat4 candlesModel = computeCandlesModel();
+    uploadDrawData(candlesModel);
+    drawModelDepth(candles, depthPrepassShader, candlesModel);
+    drawCandleInstances(depthPrepassShader, projection * view, (float)myWindow.getWindowDimensions().height, lodPixelError, true);
+
+    glm::mat4 bathroomDoorModel = computeBathroomDoorModel();
+    uploadDrawData(bathroomDoorModel);
+    drawModelDepth(bathroomDoor, depthPrepassShader, bathroomDoorModel);
+
+    glm::mat4 bathroomModel = computeBathroomModel();
+    uploadDrawData(bathroomModel);
+    drawModelDepth(bathroom, depthPrepassShader, bathroomModel);
+
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+// every model of the scene, each in its own profiler scope
+void renderModels(gps::Shader shader) {
+    //flashlight
+    gpuProfiler.beginScope("flashlight");
+    renderFlashlight(shader);
+    gpuProfiler.endScope();
+
+    //candles
+    gpuProfiler.beginScope("candles");
+    renderCandles(shader);
+    gpuProfiler.endScope();
+
+    //environment
+    gpuProfiler.beginScope("bathroom");
+    renderBathroom(shader);
+    gpuProfiler.endScope();
+    gpuProfiler.beginScope("bathroom door");
+    renderBathroomDoor(shader);
+    gpuProfiler.endScope();
+
+    //animatronics
+    gpuProfiler.beginScope("foxy");
+    renderFoxy(shader);
+    gpuProfiler.endScope();
+    gpuProfiler.beginScope("bonnie");
+    renderBonnie(shader);
+    gpuProfiler.endScope();
+}
+
+void renderForward() {
+    PROFILE_ZONE("renderForward");
     glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    myBasicShader.useShaderProgram();
+    if (depthPrepass) {
+        gpuProfiler.beginScope("depth pre-pass");
+        renderDepthPrepass();
+        gpuProfiler.endScope();
+
+        //only the fragments that won the pre-pass get shaded
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
+
+    gpuProfiler.beginScope("color pass");
 
     glActiveTexture(GL_TEXTURE2);
     glBindTexture(GL_TEXTURE_2D_ARRAY, depthMapTextureArray);
-    glUniform1i(glGetUniformLocation(myBasicShader.shaderProgram, "shadowMapArray"), 2);
 
-    glUniformMatrix4fv(glGetUniformLocation(myBasicShader.shaderProgram, "lightSpaceMatrices"),
-        5, GL_FALSE, glm::value_ptr(lightMatrices[0]));
+    //a reload resets its own variants, the rest keep their uniforms until the state behind them changes
+    if (basicVariantInputs.shadowQuality != shadowQuality || basicVariantInputs.lodTint != lodTint ||
+        basicVariantInputs.clusterBinding != lightClusters.getBindingVersion()) {
+        basicVariantInputs.shadowQuality = shadowQuality;
+        basicVariantInputs.lodTint = lodTint;
+        basicVariantInputs.clusterBinding = lightClusters.getBindingVersion();
+        myBasicShader.invalidateVariants();
+    }
+    myBasicShader.selectVariant(basicFrameVariant());
 
-    //flashlight
-    updateFlashlight();
-    renderFlashlight(myBasicShader);
+    renderModels(myBasicShader);
 
-    //candles
+    gpuProfiler.endScope();
+
+    if (depthPrepass) {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+}
+
+// sends the lighting state the deferred passes share with basic.frag (program must be in use)
+void uploadLightingUniforms(gps::Shader shader) {
+    GLuint program = shader.shaderProgram;
+
+    glUniform1i(shader.getUniformLocation("shadowMapArray"), 2);
+    glUniform1i(shader.getUniformLocation("shadowQuality"), shadowQuality);
+
+    glUniform2f(shader.getUniformLocation("screenSize"),
+        (float)myWindow.getWindowDimensions().width, (float)myWindow.getWindowDimensions().height);
+
+    lightClusters.bind(program);
+    deferredRenderer.bindGBufferTextures(program);
+}
+
+void renderDeferred() {
+    PROFILE_ZONE("renderDeferred");
+    //geometry pass
+    gpuProfiler.beginScope("g-buffer");
+    deferredRenderer.beginGeometryPass();
+
+    gBufferShader.useShaderProgram();
+    glUniform1i(gBufferShader.getUniformLocation("lodTint"), lodTint);
+
+    renderModels(gBufferShader);
+    gpuProfiler.endScope();
+
+    gpuProfiler.beginScope("deferred lighting");
+
+    //lighting passes, straight into the default framebuffer
+    glBindFramebuffer(GL_FRAMEBUFFER, myWindow.getFramebuffer());
+    glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depthMapTextureArray);
+    glActiveTexture(GL_TEXTURE0);
+
+    //the wireframe/point keys only apply to the geometry
+    GLint polygonMode[2];
+    glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    glDisable(GL_DEPTH_TEST);
+
+    //moonlight and flashlight
+    deferredLightShader.useShaderProgram();
+    uploadLightingUniforms(deferredLightShader);
+    deferredRenderer.drawFullScreen();
+
+    //point lights, one volume each
+    deferredPointShader.useShaderProgram();
+    uploadLightingUniforms(deferredPointShader);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    //back faces only, so the volume is still drawn once the camera is inside it
+    glCullFace(GL_FRONT);
+
+    GLint lightIndexLoc = deferredPointShader.getUniformLocation("lightIndex");
+    GLint volumeCenterLoc = deferredPointShader.getUniformLocation("volumeCenter");
+    GLint volumeRadiusLoc = deferredPointShader.getUniformLocation("volumeRadius");
+
+    for (int i = 0; i < lightClusters.getNumLights(); i++) {
+        float radius = lightClusters.getLightRadius(i);
+        if (radius <= 0.0f) continue;
+
+        glUniform1i(lightIndexLoc, i);
+        glUniform3fv(volumeCenterLoc, 1, glm::value_ptr(clusterLights[i].position));
+        glUniform1f(volumeRadiusLoc, radius);
+        deferredRenderer.drawLightVolume();
+    }
+
+    glCullFace(GL_BACK);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    gpuProfiler.endScope();
+    glPolygonMode(GL_FRONT_AND_BACK, polygonMode[0]);
+}
+
+void renderScene() {
+    PROFILE_ZONE("renderScene");
+    double cpuStart = myWindow.getTime();
+
+    meshesCulled = 0;
+    meshesTotal = 0;
+    meshesOccluded = 0;
+    shadowMeshesCulled = 0;
+    shadowMeshesTotal = 0;
+    meshletsCulled = 0;
+    meshletsTotal = 0;
+    candleInstancesDrawn = 0;
+
+    if (portalCulling) {
+        portalGraph.computeVisibility(myCamera.getCameraPosition(), projection * view, cameraCells);
+    } else {
+        cameraCells.valid = false;
+    }
+
+    //everything the shaders read per frame is known before the first pass
+    uniformRing.beginFrame();
+    computeLightMatrices();
+    updateFlashlight();
     updateCandleLights();
-    renderCandles(myBasicShader);
+    uploadFrameData();
 
-    //environment
-	renderBathroom(myBasicShader);
-    renderBathroomDoor(myBasicShader);
+    gpuProfiler.beginFrame();
 
-    //animatronics
-    renderFoxy(myBasicShader);
-    renderBonnie(myBasicShader);
+    gpuProfiler.beginScope("shadow maps");
+    renderShadowMaps();
+    gpuProfiler.endScope();
+
+    if (deferredShading) {
+        renderDeferred();
+    } else {
+        renderForward();
+    }
+
+    //this frame's depth culls the next frames
+    if (frustumCulling && occlusionCulling) {
+        gpuProfiler.beginScope("hi-z capture");
+        hiZBuffer.capture(deferredShading ? deferredRenderer.getFramebuffer() : myWindow.getFramebuffer(),
+            myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height, projection * view);
+        gpuProfiler.endScope();
+    }
+
+    gpuProfiler.endFrame();
+    uniformRing.endFrame();
+
+    cpuFrameMsSum += (myWindow.getTime() - cpuStart) * 1000.0;
+    cpuFrameCount++;
+}
+
+// CPU frame time, GPU time of each pass and the culled mesh count of the last frame in the window title, refreshed twice a second so it stays readable
+// the pass times are the profiler's newest results, two frames old
+void updatePassTimings(float currentTime) {
+    if (currentTime - lastProfileLog >= GPU_PROFILE_LOG_SECONDS) {
+        lastProfileLog = currentTime;
+        if (gpuProfile) {
+            gpuProfiler.printStats();
+        }
+        gpuProfiler.resetStats();
+    }
+
+    if (currentTime - lastTimingUpdate < 0.5f) return;
+    lastTimingUpdate = currentTime;
+
+    if (cpuFrameCount > 0) {
+        cpuFrameMs = cpuFrameMsSum / cpuFrameCount;
+        cpuFrameMsSum = 0.0;
+        cpuFrameCount = 0;
+    }
+
+    char prepassText[32] = "off";
+    if (depthPrepass) {
+        snprintf(prepassText, sizeof(prepassText), "%.2f ms", gpuProfiler.getLastMs("depth pre-pass"));
+    }
+
+    double colorPassMs = deferredShading ?
+        gpuProfiler.getLastMs("g-buffer") + gpuProfiler.getLastMs("deferred lighting") : gpuProfiler.getLastMs("color pass");
+
+    char instancesText[48] = "";
+    if (stressCandles > 0) {
+        snprintf(instancesText, sizeof(instancesText), " | %d/%d candle instances", candleInstancesDrawn, (int)stressCandleModels.size());
+    }
+
+    char title[320];
+    snprintf(title, sizeof(title), "OpenGL Project Core | cpu %.2f ms | shadows %.2f ms | pre-pass %s | %s %.2f ms | culled %d/%d meshes (%d occluded), %d/%d shadow casters, %d/%d meshlets%s",
+        cpuFrameMs, gpuProfiler.getLastMs("shadow maps"), prepassText,
+        deferredShading ? "deferred" : "color", colorPassMs,
+        meshesCulled, meshesTotal, meshesOccluded, shadowMeshesCulled, shadowMeshesTotal, meshletsCulled, meshletsTotal, instancesText);
+    myWindow.setTitle(title);
+}
+
+void setCameraState(const CameraState& state) {
+    myCamera.setCameraPosition(state.position);
+    myCamera.setCameraTarget(state.target);
+
+    glm::vec3 direction = glm::normalize(state.target - state.position);
+    pitch = glm::degrees(asin(direction.y));
+    yaw = glm::degrees(atan2(direction.z, direction.x));
+    myCamera.rotate(pitch, yaw);
+
+    view = myCamera.getViewMatrix();
+
+    hiZBuffer.invalidate();
+}
+
+// average ms per frame, glFinish on both ends so the GPU work is included
+double measureFrameTime(int frames) {
+    glFinish();
+    double start = myWindow.getTime();
+
+    for (int i = 0; i < frames; i++) {
+        renderScene();
+        myWindow.swapBuffers();
+        myWindow.pollEvents();
+    }
+
+    glFinish();
+    return (myWindow.getTime() - start) * 1000.0 / frames;
+}
+
+// renders every camera state with both light-space variants of basic.vert/basic.frag
+// run with LIBGL_ALWAYS_SOFTWARE=1 to measure on Mesa llvmpipe
+void runLightSpaceBenchmark(int frames) {
+    myWindow.setSwapInterval(0);
+    // all shadow layers get sampled with the flashlight on
+    flashlightOn = true;
+
+    const char* variantNames[2] = { "vertex", "fragment" };
+    std::vector<double> results[2];
+
+    for (int variant = 0; variant < 2; variant++) {
+        lightSpaceInFragment = (variant == 1);
+        myBasicShader.deleteVariants();
+        loadBasicShader();
+        initUniforms();
+
+        for (size_t i = 0; i < cameraStates.size(); i++) {
+            setCameraState(cameraStates[i]);
+            // warm up so shader compilation and uploads stay out of the timing
+            measureFrameTime(10);
+            results[variant].push_back(measureFrameTime(frames));
+        }
+    }
+
+    std::cout << "Light-space benchmark (" << frames << " frames per camera state, "
+        << glGetString(GL_RENDERER) << ")" << std::endl;
+
+    for (size_t i = 0; i < cameraStates.size(); i++) {
+        std::cout << cameraStates[i].name;
+        for (int variant = 0; variant < 2; variant++) {
+            std::cout << " | " << variantNames[variant] << ": " << results[variant][i] << " ms";
+        }
+        std::cout << std::endl;
+    }
+}
+
+// halves the stress candle count down to zero, timing instanced against one draw per copy at each step
+void runStressBenchmark(int frames) {
+    myWindow.setSwapInterval(0);
+    if (!cameraStates.empty()) {
+        setCameraState(cameraStates[0]);
+    }
+
+    std::cout << "Stress benchmark (" << frames << " frames per count, " << glGetString(GL_RENDERER) << ")" << std::endl;
+
+    for (int count = stressCandles; ; count /= 2) {
+        placeStressCandles(count);
+
+        double ms[2];
+        for (int variant = 0; variant < 2; variant++) {
+            instanceCandles = (variant == 0);
+            // warm up so buffer growth stays out of the timing
+            measureFrameTime(5);
+            ms[variant] = measureFrameTime(frames);
+        }
+
+        std::cout << count << " candles | instanced: " << ms[0] << " ms | per copy: " << ms[1] << " ms" << std::endl;
+        if (count == 0) break;
+    }
+
+    instanceCandles = true;
+    placeStressCandles(stressCandles);
+}
+
+void applyCameraPose(const gps::CameraPose& pose) {
+    myCamera.setCameraPosition(pose.position);
+    yaw = pose.yaw;
+    pitch = pose.pitch;
+    myCamera.rotate(pitch, yaw);
+    view = myCamera.getViewMatrix();
+}
+
+gps::CameraPose captureCameraPose() {
+    return { (float)simulationTime, myCamera.getCameraPosition(), yaw, pitch };
+}
+
+void applyAnimation(const AnimationState& state) {
+    doorAngle = state.doorAngle;
+    portalGraph.setPortalOpen(doorPortal, doorAngle != 0.0f);
+    for (int i = 0; i < 3 && i < (int)pointLights.size(); i++) {
+        pointLights[i].color = state.candleColors[i];
+    }
+}
+
+AnimationState captureAnimation() {
+    AnimationState state = { doorAngle };
+    for (int i = 0; i < 3 && i < (int)pointLights.size(); i++) {
+        state.candleColors[i] = pointLights[i].color;
+    }
+    return state;
+}
+
+// one fixed step of everything that moves on its own or with the keys
+void simulationStep(float deltaTime) {
+    PROFILE_ZONE("simulationStep");
+    previousCameraPose = captureCameraPose();
+    previousAnimation = captureAnimation();
+    interpolateCameraOrientation = isTransitioning;
+
+    updateCandleFlicker(deltaTime);
+    updateCameraTransition(deltaTime);
+    updateAnimatronics(deltaTime);
+    updateDoorAnimation(deltaTime);
+    processMovement(deltaTime);
+
+    simulationTime += deltaTime;
+    currentCameraPose = captureCameraPose();
+    currentAnimation = captureAnimation();
+}
+
+// runs the steps that fit into the time since the last frame and places the camera, the door and the
+// flicker between the last two; mouse look stays immediate, only transitions interpolate the orientation
+void advanceSimulation(double frameTime) {
+    //the scene still holds the interpolated state of the last frame, the steps continue from the stepped one
+    if (interpolateCameraOrientation) {
+        applyCameraPose(currentCameraPose);
+    } else {
+        myCamera.setCameraPosition(currentCameraPose.position);
+    }
+    applyAnimation(currentAnimation);
+
+    simulationAccumulator += std::min(frameTime, MAX_SIMULATION_STEPS * SIMULATION_STEP);
+    while (simulationAccumulator >= SIMULATION_STEP) {
+        simulationStep((float)SIMULATION_STEP);
+        simulationAccumulator -= SIMULATION_STEP;
+    }
+
+    float alpha = (float)(simulationAccumulator / SIMULATION_STEP);
+    gps::CameraPose pose = { (float)(simulationTime + simulationAccumulator),
+        glm::mix(previousCameraPose.position, currentCameraPose.position, alpha), yaw, pitch };
+
+    if (interpolateCameraOrientation) {
+        float yawDelta = currentCameraPose.yaw - previousCameraPose.yaw;
+        if (yawDelta > 180.0f) yawDelta -= 360.0f;
+        if (yawDelta < -180.0f) yawDelta += 360.0f;
+        pose.yaw = previousCameraPose.yaw + yawDelta * alpha;
+        pose.pitch = glm::mix(previousCameraPose.pitch, currentCameraPose.pitch, alpha);
+    }
+
+    applyCameraPose(pose);
+    sceneTime = pose.time;
+
+    AnimationState animation;
+    animation.doorAngle = glm::mix(previousAnimation.doorAngle, currentAnimation.doorAngle, alpha);
+    for (int i = 0; i < 3; i++) {
+        animation.candleColors[i] = glm::mix(previousAnimation.candleColors[i], currentAnimation.candleColors[i], alpha);
+    }
+    applyAnimation(animation);
+}
+
+// spawn, door, window and back to spawn, a few seconds each
+void buildDefaultCameraPath() {
+    cameraPath.clear();
+    for (size_t i = 0; i <= cameraStates.size(); i++) {
+        const CameraState& state = cameraStates[i % cameraStates.size()];
+        glm::vec3 direction = glm::normalize(state.target - state.position);
+
+        gps::CameraPose pose;
+        pose.time = i * DEFAULT_PATH_SEGMENT_SECONDS;
+        pose.position = state.position;
+        pose.yaw = glm::degrees(atan2(direction.z, direction.x));
+        pose.pitch = glm::degrees(asin(direction.y));
+        cameraPath.add(pose);
+    }
+}
+
+struct FrameStats {
+    double min;
+    double avg;
+    double p95;
+    double p99;
+    double max;
+};
+
+// nearest-rank percentiles
+FrameStats computeFrameStats(std::vector<double> ms) {
+    FrameStats stats = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+    if (ms.empty()) {
+        return stats;
+    }
+
+    std::sort(ms.begin(), ms.end());
+    double sum = 0.0;
+    for (double value : ms) {
+        sum += value;
+    }
+
+    stats.min = ms.front();
+    stats.avg = sum / ms.size();
+    stats.p95 = ms[std::min(ms.size() - 1, (size_t)ceil(0.95 * ms.size()) - 1)];
+    stats.p99 = ms[std::min(ms.size() - 1, (size_t)ceil(0.99 * ms.size()) - 1)];
+    stats.max = ms.back();
+    return stats;
+}
+
+// text as a quoted JSON string; Windows paths bring backslashes, driver names may bring quotes
+std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if ((unsigned char)c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)c);
+            quoted += escaped;
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+void writeBenchmarkJson(FILE* file, const std::string& renderer, int frames, const FrameStats& cpu, const FrameStats& gpu, double wallMs) {
+    fprintf(file, "{\n");
+    fprintf(file, "  \"renderer\": %s,\n", jsonString(renderer).c_str());
+    fprintf(file, "  \"path\": %s,\n", jsonString(cameraPathFile.empty() ? "built-in" : cameraPathFile).c_str());
+    fprintf(file, "  \"shading\": \"%s\",\n", deferredShading ? "deferred" : "forward");
+    fprintf(file, "  \"uniform_ring\": \"%s\",\n", uniformRing.isPersistent() ? "persistent" : "buffer_sub_data");
+    fprintf(file, "  \"frames\": %d,\n", frames);
+    fprintf(file, "  \"timestep_ms\": %.4f,\n", BENCHMARK_TIMESTEP * 1000.0f);
+    fprintf(file, "  \"seed\": %u,\n", benchmarkSeed);
+    fprintf(file, "  \"cpu_ms\": { \"min\": %.4f, \"avg\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+        cpu.min, cpu.avg, cpu.p95, cpu.p99, cpu.max);
+    fprintf(file, "  \"gpu_ms\": { \"min\": %.4f, \"avg\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+        gpu.min, gpu.avg, gpu.p95, gpu.p99, gpu.max);
+    fprintf(file, "  \"wall_ms_avg\": %.4f\n", wallMs);
+    fprintf(file, "}\n");
+}
+
+// CPU time is the simulation and command submission of a frame, GPU time spans its first to last
+// timestamp query; both only depend on the path, the seed and the frame count
+void runBenchmark(int frames) {
+    myWindow.setSwapInterval(0);
+    hiZBuffer.invalidate();
+    //every shadow layer rendered and sampled
+    flashlightOn = true;
+
+    if (cameraPathFile.empty() || !cameraPath.load(cameraPathFile)) {
+        if (!cameraPathFile.empty()) {
+            std::cout << "Falling back to the built-in camera path" << std::endl;
+            cameraPathFile.clear();
+        }
+        buildDefaultCameraPath();
+    }
+
+    gpuProfiler.keepFrameTimes(true);
+
+    //warm up on the first pose so lazy shader variants and buffer growth stay out of the timing
+    sceneTime = 0.0;
+    applyCameraPose(cameraPath.sample(0.0f));
+    for (int i = 0; i < BENCHMARK_WARMUP_FRAMES; i++) {
+        renderScene();
+        myWindow.swapBuffers();
+        myWindow.pollEvents();
+    }
+    gpuProfiler.flush();
+    gpuProfiler.clearFrameTimes();
+    gpuProfiler.resetStats();
+
+    randomEngine.seed(benchmarkSeed);
+    std::vector<double> cpuMs;
+    cpuMs.reserve(frames);
+
+    glFinish();
+    double start = myWindow.getTime();
+
+    for (int i = 0; i < frames; i++) {
+        double cpuStart = myWindow.getTime();
+        sceneTime = i * (double)BENCHMARK_TIMESTEP;
+
+        //the path drives the camera, the same fixed steps as in play drive everything else
+        applyCameraPose(cameraPath.sample((float)sceneTime));
+        for (int step = 0; step < BENCHMARK_STEPS_PER_FRAME; step++) {
+            simulationStep((float)SIMULATION_STEP);
+        }
+        renderScene();
+
+        cpuMs.push_back((myWindow.getTime() - cpuStart) * 1000.0);
+        //waits for the GPU frame two back, after the CPU time is taken
+        gpuProfiler.collect();
+        myWindow.swapBuffers();
+        myWindow.pollEvents();
+    }
+
+    glFinish();
+    double wallMs = (myWindow.getTime() - start) * 1000.0 / frames;
+    gpuProfiler.flush();
+
+    std::string renderer = (const char*)glGetString(GL_RENDERER);
+
+    FrameStats cpu = computeFrameStats(cpuMs);
+    FrameStats gpu = computeFrameStats(gpuProfiler.getFrameTimes());
+
+    //stdout also carries the log, scripts should read --benchmark-out
+    if (benchmarkOutFile.empty()) {
+        writeBenchmarkJson(stdout, renderer, frames, cpu, gpu, wallMs);
+        return;
+    }
+
+    FILE* file = fopen(benchmarkOutFile.c_str(), "w");
+    if (file) {
+        writeBenchmarkJson(file, renderer, frames, cpu, gpu, wallMs);
+        fclose(file);
+        std::cout << "Benchmark results written to " << benchmarkOutFile << std::endl;
+    } else {
+        std::cout << "Can't write benchmark results to " << benchmarkOutFile << std::endl;
+    }
+}
+
+// seeded candle flicker, both animatronics in place and the door open, so every light and model shows
+void setGoldenScene() {
+    randomEngine.seed(benchmarkSeed);
+    sceneTime = 0.0;
+    flashlightOn = true;
+
+    foxyState.isVisible = true;
+    foxyState.lightIrritation = 0.0f;
+    bonnieState.isVisible = true;
+    bonnieState.lightIrritation = 0.0f;
+
+    updateCandleFlicker(0.0f);
+    //long enough for the door to swing fully open
+    updateDoorAnimation(1.0f);
+}
+
+// returns true if every state matched its reference (or, with --golden-update, was written)
+bool runGolden() {
+    myWindow.setSwapInterval(0);
+    if (goldenUpdate) {
+        std::error_code error;
+        std::filesystem::create_directories(goldenDir, error);
+    }
+
+    WindowDimensions dimensions = myWindow.getWindowDimensions();
+    int failures = 0;
+
+    for (const CameraState& state : cameraStates) {
+        setCameraState(state);
+        setGoldenScene();
+
+        //later frames draw with Hi-Z occlusion from the earlier ones, so culling mistakes show in the image
+        gps::Image image;
+        for (int frame = 0; frame < GOLDEN_FRAMES; frame++) {
+            renderScene();
+            if (frame == GOLDEN_FRAMES - 1) {
+                gps::GoldenImage::readFramebuffer(myWindow.resolveFramebuffer(), dimensions.width, dimensions.height, image);
+            }
+            myWindow.swapBuffers();
+            myWindow.pollEvents();
+        }
+
+        std::string goldenFile = goldenDir + "/" + state.name + ".png";
+        std::string actualFile = goldenDir + "/" + state.name + ".actual.png";
+        std::string diffFile = goldenDir + "/" + state.name + ".diff.png";
+
+        if (goldenUpdate) {
+            if (gps::GoldenImage::savePng(goldenFile, image)) {
+                printf("golden %s: wrote %s\n", state.name.c_str(), goldenFile.c_str());
+            } else {
+                printf("golden %s: can't write %s\n", state.name.c_str(), goldenFile.c_str());
+                failures++;
+            }
+            continue;
+        }
+
+        gps::Image golden;
+        if (!gps::GoldenImage::loadPng(goldenFile, golden)) {
+            printf("golden %s: FAIL, no reference %s (create it with --golden-update)\n", state.name.c_str(), goldenFile.c_str());
+            gps::GoldenImage::savePng(actualFile, image);
+            failures++;
+            continue;
+        }
+
+        double psnr = gps::GoldenImage::psnr(golden, image);
+        if (psnr >= goldenMinPsnr) {
+            printf("golden %s: ok, PSNR %.2f dB\n", state.name.c_str(), psnr);
+            continue;
+        }
+
+        gps::Image diff;
+        int changed = gps::GoldenImage::makeDiff(golden, image, GOLDEN_DIFF_THRESHOLD, diff);
+        gps::GoldenImage::savePng(actualFile, image);
+        gps::GoldenImage::savePng(diffFile, diff);
+        if (golden.width != image.width || golden.height != image.height) {
+            printf("golden %s: FAIL, reference is %dx%d, render is %dx%d\n", state.name.c_str(),
+                golden.width, golden.height, image.width, image.height);
+        } else {
+            printf("golden %s: FAIL, PSNR %.2f dB < %.2f dB, %d pixels changed, see %s\n", state.name.c_str(),
+                psnr, goldenMinPsnr, changed, diffFile.c_str());
+        }
+        failures++;
+    }
+
+    if (!goldenUpdate) {
+        printf("golden: %d/%d camera states match\n", (int)cameraStates.size() - failures, (int)cameraStates.size());
+    }
+    return failures == 0;
 }
 
 void cleanup() {
+    uniformRing.destroy();
+    if (stressCandles > 0) {
+        candleInstances.destroy();
+    }
+    hiZBuffer.destroy();
+    if (gpuProfile || benchmarkFrames > 0) {
+        gpuProfiler.printStats();
+    }
+    gpuProfiler.destroy();
+    if (!cpuTraceFile.empty()) {
+        if (PROFILE_WRITE_TRACE(cpuTraceFile)) {
+            std::cout << "CPU trace written to " << cpuTraceFile << std::endl;
+        } else {
+            std::cout << "No CPU trace written to " << cpuTraceFile << ": the build lacks GPS_CPU_PROFILER or the file can't be opened" << std::endl;
+        }
+    }
+    if (deferredShading) {
+        deferredRenderer.destroy();
+    }
+    lightClusters.destroy();
+    shaderWatcher.destroy();
+    recordedPath.endRecording();
     myWindow.Delete();
     //cleanup code for your own data
 }
 
 int main(int argc, const char * argv[]) {
 
+    int lightSpaceBenchFrames = 0;
+    int stressBenchFrames = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--light-space-in-fragment") {
+            lightSpaceInFragment = true;
+        } else if (arg == "--deferred") {
+            deferredShading = true;
+        } else if (arg == "--depth-prepass") {
+            depthPrepass = true;
+        } else if (arg == "--no-lod") {
+            generateLods = false;
+        } else if (arg == "--packed-vertices") {
+            packedVertices = true;
+        } else if (arg == "--no-shader-cache") {
+            shaderCache = false;
+        } else if (arg == "--no-hot-reload") {
+            hotReload = false;
+        } else if (arg == "--cpu-trace" && i + 1 < argc) {
+            cpuTraceFile = argv[++i];
+        } else if (arg == "--gpu-profile") {
+            gpuProfile = true;
+            if (i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0) {
+                gpuProfileCsv = argv[++i];
+            }
+        } else if (arg == "--no-persistent-ring") {
+            persistentRing = false;
+        } else if (arg == "--keep-mesh-data") {
+            releaseMeshData = false;
+        } else if (arg == "--stress-candles" && i + 1 < argc) {
+            stressCandles = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--bench-stress") {
+            stressBenchFrames = (i + 1 < argc && isdigit(argv[i + 1][0])) ? std::max(1, atoi(argv[++i])) : 100;
+        } else if (arg == "--benchmark") {
+            benchmarkFrames = (i + 1 < argc && isdigit(argv[i + 1][0])) ? std::max(1, atoi(argv[++i])) : 600;
+        } else if (arg == "--camera-path" && i + 1 < argc) {
+            cameraPathFile = argv[++i];
+        } else if (arg == "--record-camera-path" && i + 1 < argc) {
+            recordPathFile = argv[++i];
+        } else if (arg == "--seed" && i + 1 < argc) {
+            benchmarkSeed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (arg == "--benchmark-out" && i + 1 < argc) {
+            benchmarkOutFile = argv[++i];
+        } else if (arg == "--golden" && i + 1 < argc) {
+            goldenDir = argv[++i];
+        } else if (arg == "--golden-update") {
+            goldenUpdate = true;
+        } else if (arg == "--golden-psnr" && i + 1 < argc) {
+            goldenMinPsnr = atof(argv[++i]);
+        } else if (arg == "--no-vsync") {
+            vsync = false;
+        } else if (arg == "--offscreen") {
+            offscreen = true;
+        } else if (arg == "--bench-light-space") {
+            lightSpaceBenchFrames = (i + 1 < argc && isdigit(argv[i + 1][0])) ? std::max(1, atoi(argv[++i])) : 300;
+        } else {
+            std::cout << "Unknown argument: " << arg << std::endl;
+        }
+    }
+
+    //nothing takes input offscreen, so only the modes that exit on their own make sense
+    if (offscreen && benchmarkFrames == 0 && goldenDir.empty() && stressBenchFrames == 0 && lightSpaceBenchFrames == 0) {
+        std::cerr << "--offscreen needs --benchmark, --golden, --bench-stress or --bench-light-space" << std::endl;
+        return EXIT_FAILURE;
+    }
+
     try {
         initOpenGLWindow();
     } catch (const std::exception& e) {
@@ -1218,12 +2658,37 @@ int main(int argc, const char * argv[]) {
     }
 
     initOpenGLState();
+    gps::Shader::enableParallelCompile();
+    if (shaderCache) {
+        gps::ProgramCache::init("shader_cache");
+    }
+    initCandleLights();
+    beginShaders();
 	initModels();
-	initShaders();
+    initStressCandles();
+    finishShaders(false);
+    finishShaders(true);
+    if (hotReload && shaderWatcher.init("shaders")) {
+        printf("Shader hot reload: watching shaders/ (%s)\n", shaderWatcher.getMethod());
+    }
+    uniformRing.init(GL_UNIFORM_BUFFER, UNIFORM_RING_FRAME_BYTES, persistentRing);
+    printf("Uniform ring: %s\n", uniformRing.isPersistent() ? "persistent mapped (ARB_buffer_storage)" : "glBufferSubData per write");
     initShadowFBO();
+    lightClusters.init();
+    if (deferredShading) {
+        deferredRenderer.init(myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+    }
 	initUniforms();
-    initCandleLights();
+    gpuProfiler.init(GPU_PROFILER_SCOPES);
+    if (gpuProfile) {
+        if (!gpuProfileCsv.empty() && !gpuProfiler.openCsv(gpuProfileCsv)) {
+            std::cout << "Can't write GPU profile to " << gpuProfileCsv << std::endl;
+        }
+    }
+    hiZBuffer.init();
+    printShaderStartup();
     initCameraStates();
+    initPortals();
     initAudio();
     setWindowCallbacks();
 
@@ -1235,26 +2700,66 @@ int main(int argc, const char * argv[]) {
 
 	glCheckError();
 
-    srand(time(NULL));
-    float lastFrame = 0.0f;
+    if (lightSpaceBenchFrames > 0) {
+        runLightSpaceBenchmark(lightSpaceBenchFrames);
+        cleanup();
+        return EXIT_SUCCESS;
+    }
+
+    if (benchmarkFrames > 0) {
+        runBenchmark(benchmarkFrames);
+        cleanup();
+        return EXIT_SUCCESS;
+    }
+
+    if (!goldenDir.empty()) {
+        bool passed = runGolden();
+        cleanup();
+        return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (stressBenchFrames > 0) {
+        if (stressCandles <= 0) {
+            std::cout << "--bench-stress needs --stress-candles N" << std::endl;
+            cleanup();
+            return EXIT_FAILURE;
+        }
+        runStressBenchmark(stressBenchFrames);
+        cleanup();
+        return EXIT_SUCCESS;
+    }
+
+    randomEngine.seed((unsigned int)time(NULL));
+    myWindow.setSwapInterval(vsync ? 1 : 0);
+    currentCameraPose = previousCameraPose = captureCameraPose();
+    currentAnimation = previousAnimation = captureAnimation();
+    float lastFrame = myWindow.getTime();
+    if (!recordPathFile.empty() && recordedPath.beginRecording(recordPathFile)) {
+        std::cout << "Recording the camera path to " << recordPathFile << std::endl;
+    }
 
 	// application loop
-	while (!glfwWindowShouldClose(myWindow.getWindow())) {
-        float currentFrame = glfwGetTime();
+	while (!myWindow.shouldClose()) {
+        PROFILE_ZONE("frame");
+        float currentFrame = myWindow.getTime();
         float deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        updateCandleFlicker(deltaTime);
-
-        updateCameraTransition(deltaTime);
-        updateAnimatronics(deltaTime);
-        updateDoorAnimation(deltaTime);
-
-        processMovement();
+        advanceSimulation(deltaTime);
+        recordedPath.record({ currentFrame, myCamera.getCameraPosition(), yaw, pitch });
+        updateShaderReload();
 	    renderScene();
+        updatePassTimings(currentFrame);
 
-		glfwPollEvents();
-		glfwSwapBuffers(myWindow.getWindow());
+        {
+            PROFILE_ZONE("pollEvents");
+            myWindow.pollEvents();
+        }
+        {
+            //waits for the GPU and vsync, the CPU side of a GPU-bound frame shows up here
+            PROFILE_ZONE("swapBuffers");
+            myWindow.swapBuffers();
+        }
 
 		glCheckError();
 	}
@@ -1,35 +1,43 @@
 #version 410 core
-layout(location=0) in vec3 vPosition;
-layout(location=1) in vec3 vNormal;
-layout(location=2) in vec2 vTexCoords;
+#include "packedVertex.glsl"
+#include "instancing.glsl"
+#include "frameData.glsl"
 
 out vec3 fPosition;
 out vec3 fNormal;
 out vec2 fTexCoords;
 //out vec4 fPosLightSpace;
 
+#ifdef LIGHT_SPACE_IN_FRAGMENT
+//the fragment stage projects into light space itself, only for the layers it samples
+out vec3 fWorldPos;
+#else
 out vec4 fPosLightSpace[5];
+#endif
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat3 normalMatrix;
-uniform mat4 lightSpaceMatrix;
-
-uniform mat4 lightSpaceMatrices[5];
+//same computation as depthPrepass.vert, so GL_EQUAL against the pre-pass depth holds
+invariant gl_Position;
 
 void main() {
-    vec4 worldPos = model * vec4(vPosition, 1.0f);
+    vec4 worldPos = modelMatrix() * vec4(decodePosition(), 1.0f);
     vec4 fragPosEye = view * worldPos;
     
     fPosition = fragPosEye.xyz;
     
-    fNormal = normalize(normalMatrix * vNormal);
+    //DrawData's normal matrix does not apply to instances; they only rotate and scale uniformly,
+    //so their upper 3x3 is the normal matrix up to a scale the normalize below removes
+    mat3 normalMat = instanced ? mat3(view * instanceModel) : normalMatrix;
+    fNormal = normalize(normalMat * decodeNormal());
     fTexCoords = vTexCoords;
 
-    for(int i = 0; i < 5; i++) {
+#ifdef LIGHT_SPACE_IN_FRAGMENT
+    fWorldPos = worldPos.xyz;
+#else
+    //moon, flashlight and the candle layers this permutation samples
+    for(int i = 0; i < FIRST_POINT_SHADOW_LAYER + NUM_SHADOWED_LIGHTS; i++) {
         fPosLightSpace[i] = lightSpaceMatrices[i] * worldPos;
     }   
+#endif
 
     gl_Position = projection * fragPosEye;
 }
\ No newline at end of file
@@ -0,0 +1,39 @@
+#version 410 core
+in vec2 fTexCoords;
+
+out vec4 fColor;
+
+//matrices and light state
+#include "frameData.glsl"
+
+#include "lighting.glsl"
+#include "gbuffer.glsl"
+
+//moonlight and flashlight for every pixel, point lights are added by deferredPoint.frag
+void main() {
+    float depth = texture(gDepth, fTexCoords).r;
+    if (depth <= 0.0) {
+        fColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    vec3 fragPosEye = reconstructEyePos(fTexCoords, depth);
+    fragPosWorld = (inverseView * vec4(fragPosEye, 1.0)).xyz;
+    vec3 normalEye = normalize(texture(gNormal, fTexCoords).xyz);
+    vec3 albedo = texture(gAlbedo, fTexCoords).rgb;
+    vec3 specularMap = texture(gSpecular, fTexCoords).rgb;
+
+    computeDirLight(normalEye, fragPosEye);
+
+    vec3 spotLightContrib = computeSpotLight(normalEye, fragPosEye);
+    float flashShadow = 0.0;
+    if (any(greaterThan(spotLightContrib, vec3(0.0)))) {
+        flashShadow = computeShadow(1, normalEye, getEyeDir(spotLightDir));
+    }
+
+    vec3 color = (ambient * albedo);
+    color += (diffuse * albedo + specular * specularMap);
+    color += (1.0 - flashShadow) * spotLightContrib * albedo;
+
+    fColor = vec4(color, 1.0);
+}
@@ -0,0 +1,9 @@
+#version 410 core
+out vec2 fTexCoords;
+
+void main() {
+    //one triangle covering the screen, no vertex buffer needed
+    vec2 position = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    fTexCoords = position;
+    gl_Position = vec4(position * 2.0 - 1.0, 0.0, 1.0);
+}
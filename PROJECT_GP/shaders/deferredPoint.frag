@@ -0,0 +1,36 @@
+#version 410 core
+out vec4 fColor;
+
+//matrices and light state
+#include "frameData.glsl"
+
+uniform vec2 screenSize;
+//index into lightData of the light this volume belongs to
+uniform int lightIndex;
+
+#include "lighting.glsl"
+#include "gbuffer.glsl"
+
+//one point light, additively blended over the pixels its volume covers
+void main() {
+    vec2 uv = gl_FragCoord.xy / screenSize;
+    float depth = texture(gDepth, uv).r;
+    if (depth <= 0.0) {
+        discard;
+    }
+
+    PointLight light = fetchPointLight(lightIndex);
+
+    vec3 fragPosEye = reconstructEyePos(uv, depth);
+    vec3 lightPosEye = (view * vec4(light.position, 1.0)).xyz;
+    //the volume also covers pixels whose surface lies in front of or behind the sphere
+    if (length(lightPosEye - fragPosEye) > light.radius) {
+        discard;
+    }
+
+    fragPosWorld = (inverseView * vec4(fragPosEye, 1.0)).xyz;
+    vec3 normalEye = normalize(texture(gNormal, uv).xyz);
+    vec3 albedo = texture(gAlbedo, uv).rgb;
+
+    fColor = vec4(computeShadowedPointLight(light, normalEye, fragPosEye) * albedo, 1.0);
+}
@@ -0,0 +1,12 @@
+#version 410 core
+layout(location=0) in vec3 vPosition;
+
+#include "frameData.glsl"
+
+//unit sphere placed and scaled to cover the light's radius
+uniform vec3 volumeCenter;
+uniform float volumeRadius;
+
+void main() {
+    gl_Position = projection * view * vec4(volumeCenter + vPosition * volumeRadius, 1.0);
+}
@@ -1,11 +1,11 @@
 #version 410 core
 
-layout(location=0) in vec3 vPosition;
+#include "packedVertex.glsl"
+#include "instancing.glsl"
 
 uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(vPosition, 1.0);
+    gl_Position = lightSpaceMatrix * modelMatrix() * vec4(decodePosition(), 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,14 @@
+#version 410 core
+#include "packedVertex.glsl"
+#include "instancing.glsl"
+#include "frameData.glsl"
+
+//must match basic.vert bit for bit, the color pass tests against this depth with GL_EQUAL
+invariant gl_Position;
+
+void main() {
+    vec4 worldPos = modelMatrix() * vec4(decodePosition(), 1.0f);
+    vec4 fragPosEye = view * worldPos;
+
+    gl_Position = projection * fragPosEye;
+}
@@ -0,0 +1,9 @@
+#ifndef DRAW_DATA_GLSL
+#define DRAW_DATA_GLSL
+//transforms of one draw, written into the uniform ring right before it (DRAW_DATA_BINDING in main.cpp)
+layout(std140) uniform DrawData {
+    mat4 model;
+    //inverse transpose of view * model
+    mat3 normalMatrix;
+};
+#endif
@@ -0,0 +1,30 @@
+#ifndef FRAME_DATA_GLSL
+#define FRAME_DATA_GLSL
+//layers 0 and 1 are the moon and the flashlight, the candles' follow. A permutation that defines
+//NUM_SHADOWED_LIGHTS only carries the code for that many candle layers
+#define FIRST_POINT_SHADOW_LAYER 2
+#ifndef NUM_SHADOWED_LIGHTS
+#define NUM_SHADOWED_LIGHTS 3
+#endif
+
+//state shared by every draw of a frame, written once per frame into the uniform ring (FRAME_DATA_BINDING in main.cpp);
+//the members keep the names they had as plain uniforms. Layout matches struct FrameData in main.cpp
+layout(std140) uniform FrameData {
+    mat4 view;
+    mat4 projection;
+    mat4 inverseView;
+    mat4 lightSpaceMatrices[5];
+
+    //moonlight, flashlight and its cone/attenuation, each scalar packed after a vec3
+    vec3 lightDir;
+    float spotLightCutOff;
+    vec3 lightColor;
+    float spotLightOuterCutOff;
+    vec3 spotLightPos;
+    float spotLightConstant;
+    vec3 spotLightDir;
+    float spotLightLinear;
+    vec3 spotLightColor;
+    float spotLightQuadratic;
+};
+#endif
@@ -0,0 +1,24 @@
+#version 410 core
+in vec3 fPosition;
+in vec3 fNormal;
+in vec2 fTexCoords;
+
+//G-buffer layout, see gps::DeferredRenderer
+layout(location = 0) out vec4 gAlbedo;
+layout(location = 1) out vec4 gNormal;
+layout(location = 2) out vec4 gSpecular;
+layout(location = 3) out float gDepth;
+
+// textures
+uniform sampler2D diffuseTexture;
+uniform sampler2D specularTexture;
+
+#include "lodTint.glsl"
+
+void main() {
+    gAlbedo = vec4(applyLodTint(texture(diffuseTexture, fTexCoords).rgb), 1.0);
+    gNormal = vec4(normalize(fNormal), 0.0);
+    gSpecular = vec4(texture(specularTexture, fTexCoords).rgb, 1.0);
+    //linear eye depth, 0 means nothing was drawn
+    gDepth = -fPosition.z;
+}
@@ -0,0 +1,20 @@
+//G-buffer sampling for the deferred lighting passes, pulled in with #include "gbuffer.glsl"
+//the including shader declares projection, inverseView and lightSpaceMatrices[5]
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gSpecular;
+uniform sampler2D gDepth;
+
+//world position of the fragment being lit, used for the light-space projections
+vec3 fragPosWorld;
+
+vec4 getPosLightSpace(int layer) {
+    return lightSpaceMatrices[layer] * vec4(fragPosWorld, 1.0);
+}
+
+//eye space position from screen uv and the linear depth stored in gDepth
+vec3 reconstructEyePos(vec2 uv, float depth) {
+    vec2 ndc = uv * 2.0 - 1.0;
+    return vec3(ndc.x * depth / projection[0][0], ndc.y * depth / projection[1][1], -depth);
+}
@@ -0,0 +1,27 @@
+#version 410 core
+//one Hi-Z reduction step: each texel keeps the farthest depth of the source texels it covers
+
+uniform sampler2D sourceDepth;
+uniform int sourceLevel;
+uniform ivec2 sourceSize;
+
+out float maxDepth;
+
+void main() {
+    ivec2 base = ivec2(gl_FragCoord.xy) * 2;
+    ivec2 last = sourceSize - 1;
+
+    //odd source sizes leave a third row/column for the last texel, fold it in to stay conservative
+    ivec2 extent = ivec2(
+        (base.x + 3 == sourceSize.x) ? 3 : 2,
+        (base.y + 3 == sourceSize.y) ? 3 : 2);
+
+    float result = 0.0;
+    for (int y = 0; y < extent.y; y++) {
+        for (int x = 0; x < extent.x; x++) {
+            result = max(result, texelFetch(sourceDepth, min(base + ivec2(x, y), last), sourceLevel).r);
+        }
+    }
+
+    maxDepth = result;
+}
@@ -0,0 +1,11 @@
+//model matrix of the vertex: per instance for Model3D::DrawInstanced, which sets instanced,
+//DrawData's model for every other draw; the attribute takes locations 3-6 (gps::InstanceBuffer)
+#include "drawData.glsl"
+
+layout(location=3) in mat4 instanceModel;
+
+uniform bool instanced;
+
+mat4 modelMatrix() {
+    return instanced ? instanceModel : model;
+}
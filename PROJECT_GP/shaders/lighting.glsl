@@ -0,0 +1,202 @@
+//shared Blinn-Phong lighting and shadow sampling, pulled in with #include "lighting.glsl"
+//the including shader defines getPosLightSpace(); view and the light state come from FrameData
+//all positions and normals passed to these functions are in eye space
+#include "frameData.glsl"
+
+uniform sampler2DArrayShadow shadowMapArray;
+//0 - single hardware PCF tap, 1 - 4-tap rotated Poisson, 2 - 9-tap grid
+uniform int shadowQuality;
+
+//candles - clustered point lights, filled in by gps::LightClusters
+struct PointLight {
+    vec3 position;
+    vec3 color;
+    float constant;
+    float linear;
+    float quadratic;
+    float radius;
+    int shadowLayer;
+};
+
+uniform samplerBuffer lightData;     // 3 texels per light
+uniform usamplerBuffer clusterGrid;  // (offset, count) into lightIndices per cluster
+uniform usamplerBuffer lightIndices;
+uniform ivec3 clusterDims;
+uniform vec2 clusterTileSize;        // in pixels
+uniform vec2 clusterZParams;         // slice = log(depth) * x - y
+
+//components
+vec3 ambient;
+float ambientStrength = 0.00f;
+vec3 diffuse;
+vec3 specular;
+float specularStrength = 0.3f;
+int shininess = 16;
+
+vec4 getPosLightSpace(int layer);
+
+PointLight fetchPointLight(int index) {
+    vec4 t0 = texelFetch(lightData, index * 3);
+    vec4 t1 = texelFetch(lightData, index * 3 + 1);
+    vec4 t2 = texelFetch(lightData, index * 3 + 2);
+
+    PointLight light;
+    light.position = t0.xyz;
+    light.radius = t0.w;
+    light.color = t1.rgb;
+    light.constant = t1.w;
+    light.linear = t2.x;
+    light.quadratic = t2.y;
+    light.shadowLayer = int(t2.z);
+    return light;
+}
+
+int computeClusterIndex(vec3 fragPosEye) {
+    ivec3 cluster;
+    cluster.xy = ivec2(gl_FragCoord.xy / clusterTileSize);
+    cluster.z = int(max(log(-fragPosEye.z) * clusterZParams.x - clusterZParams.y, 0.0));
+    cluster = min(cluster, clusterDims - 1);
+    return cluster.x + clusterDims.x * (cluster.y + clusterDims.y * cluster.z);
+}
+
+vec3 computePointLight(PointLight light, vec3 normalEye, vec3 fragPosEye) {
+    vec3 lightPosEye = (view * vec4(light.position, 1.0)).xyz;
+    
+    vec3 lightDir = normalize(lightPosEye - fragPosEye);
+    
+    float diff = max(dot(normalEye, lightDir), 0.0);
+    vec3 diffuse = light.color * diff;
+    
+    vec3 viewDir = normalize(-fragPosEye);
+    vec3 halfVector = normalize(lightDir + viewDir);
+    float spec = 0.0;
+    if (diff > 0.0) {
+        spec = pow(max(dot(normalEye, halfVector), 0.0), shininess);
+    }
+    vec3 specular = light.color * spec * specularStrength;
+    
+    float distance = length(lightPosEye - fragPosEye);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + 
+                               light.quadratic * (distance * distance));
+    //fade to zero at the cluster radius so there is no seam where a light stops being assigned
+    float falloff = clamp(1.0 - pow(distance / light.radius, 4.0), 0.0, 1.0);
+    attenuation *= falloff * falloff;
+    
+    diffuse *= attenuation;
+    specular *= attenuation;
+    
+    return diffuse + specular;
+}
+
+const vec2 poissonDisk[4] = vec2[](
+    vec2(-0.94201624, -0.39906216),
+    vec2(0.94558609, -0.76890725),
+    vec2(-0.09418410, -0.92938870),
+    vec2(0.34495938, 0.29387760)
+);
+
+//returns the shadowed fraction; every tap is a bilinear 2x2 compare done by the sampler
+float computeShadow(int layer, vec3 normalEye, vec3 lightDirForBias) {
+    vec4 posLightSpace = getPosLightSpace(layer);
+    vec3 projCoords = posLightSpace.xyz / posLightSpace.w;
+    projCoords = projCoords * 0.5 + 0.5;
+    
+    if(projCoords.z > 1.0) return 0.0;
+    
+    float bias = max(0.005 * (1.0 - dot(normalEye, lightDirForBias)), 0.0005);
+    float refDepth = projCoords.z - bias;
+    
+    if (shadowQuality == 0) {
+        return 1.0 - texture(shadowMapArray, vec4(projCoords.xy, layer, refDepth));
+    }
+
+    float lit = 0.0;
+    vec2 texelSize = 1.0 / textureSize(shadowMapArray, 0).xy;
+
+    if (shadowQuality == 1) {
+        //rotate the disk per pixel (interleaved gradient noise) so the 4 taps don't band
+        float angle = 6.2831853 * fract(52.9829189 * fract(dot(gl_FragCoord.xy, vec2(0.06711056, 0.00583715))));
+        mat2 rotation = mat2(cos(angle), sin(angle), -sin(angle), cos(angle));
+        for(int i = 0; i < 4; ++i) {
+            vec2 offset = rotation * poissonDisk[i] * texelSize * 1.5;
+            lit += texture(shadowMapArray, vec4(projCoords.xy + offset, layer, refDepth));
+        }
+        return 1.0 - lit / 4.0;
+    }
+
+    for(int x = -1; x <= 1; ++x) {
+        for(int y = -1; y <= 1; ++y) {
+            lit += texture(shadowMapArray, vec4(projCoords.xy + vec2(x, y) * texelSize, layer, refDepth));
+        }
+    }
+    return 1.0 - lit / 9.0;
+}
+
+vec3 getEyeDir(vec3 worldDir) {
+    return normalize((view * vec4(worldDir, 0.0)).xyz);
+}
+
+void computeDirLight(vec3 normalEye, vec3 fragPosEye) {
+    vec3 lightDirEye = (view * vec4(-lightDir, 0.0)).xyz;
+    vec3 lightDirN = normalize(lightDirEye);
+    
+    vec3 viewDirN = normalize(-fragPosEye);
+    
+    vec3 halfVector = normalize(lightDirN + viewDirN);
+    
+    ambient = ambientStrength * lightColor;
+    
+    diffuse = max(dot(normalEye, lightDirN), 0.0f) * lightColor;
+    
+    if (dot(normalEye, lightDirN) > 0.0) {
+        float specCoeff = pow(max(dot(normalEye, halfVector), 0.0f), shininess);
+        specular = specularStrength * specCoeff * lightColor;
+    } else {
+        specular = vec3(0.0);
+    }
+}
+
+vec3 computeSpotLight(vec3 normalEye, vec3 fragPosEye) {
+    vec3 spotPosEye = (view * vec4(spotLightPos, 1.0)).xyz;
+    vec3 spotDirEye = normalize((view * vec4(spotLightDir, 0.0)).xyz);
+    
+    vec3 lightDirToFrag = normalize(spotPosEye - fragPosEye);
+    
+    float theta = dot(lightDirToFrag, normalize(-spotDirEye));
+    float epsilon = spotLightCutOff - spotLightOuterCutOff;
+    float intensity = clamp((theta - spotLightOuterCutOff) / epsilon, 0.0, 1.0);
+    
+    float spotDiff = max(dot(normalEye, lightDirToFrag), 0.0);
+    
+    vec3 viewDirN = normalize(-fragPosEye);
+    vec3 halfVector = normalize(lightDirToFrag + viewDirN);
+    float spotSpec = 0.0;
+    if (spotDiff > 0.0) {
+        spotSpec = pow(max(dot(normalEye, halfVector), 0.0), shininess);
+    }
+    
+    float distance = length(spotPosEye - fragPosEye);
+    float attenuation = 1.0 / (spotLightConstant + spotLightLinear * distance + 
+                               spotLightQuadratic * (distance * distance));
+    
+    // Combine diffuse and specular with intensity and attenuation
+    vec3 spotDiffuse = spotLightColor * spotDiff * intensity * attenuation;
+    vec3 spotSpecular = spotLightColor * spotSpec * specularStrength * intensity * attenuation;
+    
+    return spotDiffuse + spotSpecular;
+}
+
+//point light with its shadow layer applied, if it has one
+vec3 computeShadowedPointLight(PointLight light, vec3 normalEye, vec3 fragPosEye) {
+    vec3 pLight = computePointLight(light, normalEye, fragPosEye);
+    float pShadow = 0.0;
+
+#if NUM_SHADOWED_LIGHTS > 0
+    //no need to sample a shadow layer for a light that doesn't reach this fragment
+    if (light.shadowLayer >= 0 && light.shadowLayer < FIRST_POINT_SHADOW_LAYER + NUM_SHADOWED_LIGHTS && any(greaterThan(pLight, vec3(0.0)))) {
+        vec3 dirToCandle = normalize(light.position - fragPosEye);
+        pShadow = computeShadow(light.shadowLayer, normalEye, dirToCandle);
+    }
+#endif
+    return pLight * (1.0 - pShadow);
+}
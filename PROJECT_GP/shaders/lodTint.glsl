@@ -0,0 +1,9 @@
+//debug view: tints each mesh by the level of detail it was drawn with (see gps::Model3D::SelectLods)
+uniform int lodLevel;
+uniform bool lodTint;
+
+const vec3 LOD_TINTS[4] = vec3[](vec3(1.0), vec3(0.4, 1.0, 0.4), vec3(0.4, 0.6, 1.0), vec3(1.0, 0.4, 0.4));
+
+vec3 applyLodTint(vec3 color) {
+    return lodTint ? color * LOD_TINTS[clamp(lodLevel, 0, 3)] : color;
+}
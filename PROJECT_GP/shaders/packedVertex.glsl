@@ -0,0 +1,33 @@
+//vertex attributes of gps::Mesh; built with PACKED_VERTICES they come as gps::PackedVertex
+#ifdef PACKED_VERTICES
+layout(location=0) in vec3 vPosition;   //0..1 inside the mesh's box
+layout(location=1) in vec2 vNormal;     //octahedral, -1..1
+layout(location=2) in vec2 vTexCoords;  //half floats, widened by the vertex fetch
+
+uniform vec3 positionScale;
+uniform vec3 positionBias;
+
+vec3 decodePosition() {
+    return positionBias + positionScale * vPosition;
+}
+
+vec3 decodeNormal() {
+    vec3 n = vec3(vNormal, 1.0 - abs(vNormal.x) - abs(vNormal.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(vNormal.yx)) * vec2(vNormal.x >= 0.0 ? 1.0 : -1.0, vNormal.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+#else
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec3 vNormal;
+layout(location=2) in vec2 vTexCoords;
+
+vec3 decodePosition() {
+    return vPosition;
+}
+
+vec3 decodeNormal() {
+    return vNormal;
+}
+#endif